@@ -0,0 +1,4 @@
+#include <stdio.h>
+#include "fslbase.h"
+#include "html.c"
+int main(int c, char **v){ Blob o=empty_blob; html_sanitize(&o, v[1]); printf("%s\n", blob_str(&o)); return 0;}
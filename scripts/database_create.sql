@@ -1,7 +1,11 @@
+PRAGMA auto_vacuum = INCREMENTAL;
+
 CREATE TABLE tags (
 	id INTEGER PRIMARY KEY AUTOINCREMENT,
 	title VARCHAR(100),
 	description VARCHAR(100),
+	keepdays INTEGER,
+	keepitems INTEGER,
 	UNIQUE(title)
 );
 
@@ -13,6 +17,14 @@ CREATE TABLE channels (
 	language VARCHAR(20),
 	title VARCHAR(100),
 	description VARCHAR(100),
+	site VARCHAR(100),
+	keepdays INTEGER,
+	keepitems INTEGER,
+	truncated INTEGER,
+	failures INTEGER,
+	error VARCHAR(20),
+	status VARCHAR(64),
+	retry TIMESTAMP,
 	UNIQUE(link)
 );
 
@@ -23,7 +35,68 @@ CREATE TABLE feeds (
 	link VARCHAR(100),
 	title VARCHAR(100),
 	description TEXT,
-	pubdate VARCHAR(50)
+	summary TEXT,
+	pubdate VARCHAR(50),
+	ingested TIMESTAMP,
+	duplicate INTEGER
 );
 
 CREATE INDEX feeds_pubdate_idx on feeds(pubdate);
+CREATE INDEX feeds_chanid_idx on feeds(chanid);
+
+CREATE TABLE feeds_archive (
+	id INTEGER PRIMARY KEY,
+	chanid INTEGER,
+	modified TIMESTAMP,
+	link VARCHAR(100),
+	title VARCHAR(100),
+	description BLOB,
+	pubdate VARCHAR(50)
+);
+
+CREATE INDEX feeds_archive_link_idx on feeds_archive(link);
+
+CREATE VIRTUAL TABLE feeds_fts USING fts5(
+	title,
+	description,
+	content='',
+	contentless_delete=1
+);
+
+CREATE TRIGGER feeds_fts_delete AFTER DELETE ON feeds BEGIN
+	DELETE FROM feeds_fts WHERE rowid = old.id;
+END;
+
+CREATE TABLE feeds_simhash (
+	feedid INTEGER PRIMARY KEY,
+	created TIMESTAMP,
+	hash INTEGER,
+	band0 INTEGER,
+	band1 INTEGER,
+	band2 INTEGER,
+	band3 INTEGER
+);
+
+CREATE INDEX feeds_simhash_band0_idx on feeds_simhash(band0);
+CREATE INDEX feeds_simhash_band1_idx on feeds_simhash(band1);
+CREATE INDEX feeds_simhash_band2_idx on feeds_simhash(band2);
+CREATE INDEX feeds_simhash_band3_idx on feeds_simhash(band3);
+
+CREATE TRIGGER feeds_simhash_delete AFTER DELETE ON feeds BEGIN
+	DELETE FROM feeds_simhash WHERE feedid = old.id;
+END;
+
+CREATE TABLE dictionary (
+	id INTEGER PRIMARY KEY AUTOINCREMENT,
+	created TIMESTAMP,
+	data BLOB
+);
+
+CREATE TABLE subscriptions (
+	chanid INTEGER PRIMARY KEY,
+	hub VARCHAR(100),
+	topic VARCHAR(100),
+	secret VARCHAR(64),
+	requested TIMESTAMP,
+	expires TIMESTAMP
+);
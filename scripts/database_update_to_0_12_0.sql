@@ -0,0 +1,87 @@
+CREATE VIRTUAL TABLE feeds_fts USING fts5(
+	title,
+	description,
+	content='',
+	contentless_delete=1
+);
+
+CREATE TRIGGER feeds_fts_delete AFTER DELETE ON feeds BEGIN
+	DELETE FROM feeds_fts WHERE rowid = old.id;
+END;
+
+-- existing items are indexed together with their html markup
+INSERT INTO feeds_fts (rowid, title, description)
+	SELECT id, title, description FROM feeds;
+
+-- fingerprints are collected for the new items only
+CREATE TABLE feeds_simhash (
+	feedid INTEGER PRIMARY KEY,
+	created TIMESTAMP,
+	hash INTEGER,
+	band0 INTEGER,
+	band1 INTEGER,
+	band2 INTEGER,
+	band3 INTEGER
+);
+
+CREATE INDEX feeds_simhash_band0_idx on feeds_simhash(band0);
+CREATE INDEX feeds_simhash_band1_idx on feeds_simhash(band1);
+CREATE INDEX feeds_simhash_band2_idx on feeds_simhash(band2);
+CREATE INDEX feeds_simhash_band3_idx on feeds_simhash(band3);
+
+CREATE TRIGGER feeds_simhash_delete AFTER DELETE ON feeds BEGIN
+	DELETE FROM feeds_simhash WHERE feedid = old.id;
+END;
+
+ALTER TABLE tags ADD COLUMN keepdays INTEGER;
+ALTER TABLE tags ADD COLUMN keepitems INTEGER;
+ALTER TABLE channels ADD COLUMN keepdays INTEGER;
+ALTER TABLE channels ADD COLUMN keepitems INTEGER;
+
+CREATE INDEX feeds_chanid_idx on feeds(chanid);
+
+CREATE TABLE feeds_archive (
+	id INTEGER PRIMARY KEY,
+	chanid INTEGER,
+	modified TIMESTAMP,
+	link VARCHAR(100),
+	title VARCHAR(100),
+	description BLOB,
+	pubdate VARCHAR(50)
+);
+
+CREATE INDEX feeds_archive_link_idx on feeds_archive(link);
+
+PRAGMA auto_vacuum = INCREMENTAL;
+VACUUM;
+
+CREATE TABLE dictionary (
+	id INTEGER PRIMARY KEY AUTOINCREMENT,
+	created TIMESTAMP,
+	data BLOB
+);
+
+ALTER TABLE feeds ADD COLUMN summary TEXT;
+
+ALTER TABLE channels ADD COLUMN truncated INTEGER;
+
+ALTER TABLE channels ADD COLUMN site VARCHAR(100);
+
+CREATE TABLE subscriptions (
+	chanid INTEGER PRIMARY KEY,
+	hub VARCHAR(100),
+	topic VARCHAR(100),
+	secret VARCHAR(64),
+	requested TIMESTAMP,
+	expires TIMESTAMP
+);
+
+ALTER TABLE channels ADD COLUMN failures INTEGER;
+ALTER TABLE channels ADD COLUMN error VARCHAR(20);
+ALTER TABLE channels ADD COLUMN status VARCHAR(64);
+ALTER TABLE channels ADD COLUMN retry TIMESTAMP;
+
+ALTER TABLE feeds ADD COLUMN ingested TIMESTAMP;
+UPDATE feeds SET ingested = strftime('%s', 'now');
+
+ALTER TABLE feeds ADD COLUMN duplicate INTEGER;
@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2026 Nikola Kolev <koue@chaosophia.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Feed body transfer.
+ *
+ * The body is read in chunks. libfetch(3) does not let us ask for a
+ * Content-Encoding, yet plenty of feeds arrive compressed anyway
+ * (pre-compressed .xml.gz files, servers which compress regardless of
+ * the request). The first bytes of the body are sniffed for the gzip or
+ * zlib header and such bodies are inflated chunk by chunk straight into
+ * the parser input, the compressed body is never held in memory. The
+ * zlib header is two bytes with a checksum, plain text matches it now
+ * and then: a body whose first chunk does not inflate to some output is
+ * taken as it is.
+ *
+ * The parser input is limited to max bytes. The transfer is stopped once
+ * the limit is hit and the truncated body is handed to the parser.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <fslbase.h>
+#include <zlib.h>
+
+#include "rss.h"
+
+#define BODY_CHUNK	16384
+
+/* gzip member or zlib stream */
+static int
+body_compressed(const unsigned char *p, size_t len)
+{
+	if (len < 2)
+		return (0);
+	if (p[0] == 0x1f && p[1] == 0x8b)
+		return (1);
+	/* deflate, window up to 32K, valid header checksum */
+	return ((p[0] & 0x8f) == 0x08 && (p[0] >> 4) <= 7 &&
+	    ((p[0] << 8) | p[1]) % 31 == 0);
+}
+
+/* append up to the limit, returns 1 once it is reached */
+static int
+body_append(Blob *body, const unsigned char *p, size_t len, size_t max)
+{
+	int full = 0;
+
+	if (blob_size(body) + len > max) {
+		len = max - blob_size(body);
+		full = 1;
+	}
+	blob_append(body, (const char *)p, len);
+	return (full);
+}
+
+/* inflate state of a compressed body */
+struct body_zstream {
+	z_stream z;
+	int members;	/* complete gzip members (or zlib stream) */
+	int trailer;	/* the bytes after the last member are skipped */
+};
+
+static int
+body_inflate(struct body_zstream *zs, Blob *body, unsigned char *in,
+    size_t len, size_t max)
+{
+	unsigned char out[BODY_CHUNK];
+	z_stream *z = &zs->z;
+	int rc;
+
+	if (zs->trailer)
+		return (0);
+	z->next_in = in;
+	z->avail_in = len;
+	while (z->avail_in > 0) {
+		z->next_out = out;
+		z->avail_out = sizeof(out);
+		rc = inflate(z, Z_NO_FLUSH);
+		if (rc != Z_OK && rc != Z_STREAM_END && rc != Z_BUF_ERROR) {
+			if (zs->members == 0)
+				return (-1);
+			/* padding or garbage after the last member */
+			dmsg(0, "%s: trailing bytes skipped", __func__);
+			zs->trailer = 1;
+			return (z->total_out > 0 ? 1 : 0);
+		}
+		metrics_add(M_BODY_INFLATED_BYTES, sizeof(out) - z->avail_out);
+		if (body_append(body, out, sizeof(out) - z->avail_out, max))
+			return (1);
+		/* concatenated gzip members */
+		if (rc == Z_STREAM_END) {
+			zs->members++;
+			if (inflateReset(z) != Z_OK)
+				return (-1);
+		}
+	}
+	return (0);
+}
+
+/*
+ * Read body from fp into body, at most max bytes. Returns 1 when the body
+ * has been truncated, at the limit or by a compressed stream which ends
+ * early, -1 on broken compressed stream.
+ */
+int
+body_read(Blob *body, FILE *fp, size_t max)
+{
+	unsigned char in[BODY_CHUNK];
+	struct body_zstream zs;
+	int compressed = -1, rc = 0;
+	size_t n;
+
+	memset(&zs, 0, sizeof(zs));
+	while (rc == 0 && (n = fread(in, 1, sizeof(in), fp)) > 0) {
+		metrics_add(M_BODY_BYTES, n);
+		if (compressed == -1 && (compressed = body_compressed(in, n))) {
+			/* 15 + 32, zlib or gzip header is detected */
+			if (inflateInit2(&zs.z, 47) != Z_OK)
+				return (-1);
+			rc = body_inflate(&zs, body, in, n, max);
+			if (rc != -1 && blob_size(body) > 0) {
+				dmsg(0, "%s: compressed body", __func__);
+				continue;
+			}
+			/* false positive, keep the raw bytes */
+			inflateEnd(&zs.z);
+			memset(&zs, 0, sizeof(zs));
+			blob_reset(body);
+			compressed = 0;
+		}
+		if (compressed)
+			rc = body_inflate(&zs, body, in, n, max);
+		else
+			rc = body_append(body, in, n, max);
+	}
+	/* the last member has not reached its end */
+	if (compressed == 1 && rc == 0 && !zs.trailer &&
+	    (zs.members == 0 || zs.z.total_in > 0)) {
+		dmsg(0, "%s: compressed body cut short", __func__);
+		rc = 1;
+	}
+	if (rc == 1)
+		dmsg(0, "%s: body truncated at %zu bytes", __func__, max);
+	if (compressed == 1)
+		inflateEnd(&zs.z);
+	return (rc);
+}
@@ -0,0 +1,383 @@
+/*
+ * Copyright (c) 2026 Nikola Kolev <koue@chaosophia.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Crawl schedule.
+ *
+ * The channels are grouped by host and the hosts are visited round-robin,
+ * one channel at a time. Requests to the same host are spread over the
+ * whole run instead of coming back to back, and with a delay (-w) no
+ * host gets two requests within the delay. The crawler sleeps only when
+ * every host left has been hit too recently.
+ *
+ * With -r the unique hosts are looked up before the run by a pool of
+ * threads, the channels of the names which do not exist are skipped
+ * without a fetch. The pass only marks the unknown names, libfetch does
+ * its own lookup and cannot be given the address.
+ *
+ * Every fetch leaves its outcome in the channel: the consecutive
+ * failures, the class of the last error and the last status (reason
+ * phrase of the HTTP answer or the system error). A failed channel is
+ * not queued until retry, the delay doubles with every failure from
+ * CRAWL_BACKOFF up to CRAWL_BACKOFF_MAX. The first fetch which works
+ * resets it. The first lookup failure is tried again at the next run,
+ * an unknown name is often a passing resolver problem, the backoff
+ * starts with the second one. Redirects are followed by libfetch, which
+ * does not tell the final location, the link is kept as it is.
+ */
+
+#include <sys/param.h>
+#include <sys/socket.h>
+#include <ctype.h>
+#include <errno.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <fetch.h>
+#include <fslbase.h>
+#include <fsldb.h>
+#include <sqlite3.h>
+
+#include "rss.h"
+
+#define	CRAWL_BACKOFF		3600		/* one hour */
+#define	CRAWL_BACKOFF_MAX	(7 * 86400)	/* a week */
+#define	CRAWL_BUCKETS		4096		/* host lookup table */
+
+struct crawl_channel {
+	int id;
+	time_t modified;
+	char *link;
+	long tagid;
+	TAILQ_ENTRY(crawl_channel) entry;
+};
+
+struct crawl_host {
+	char name[MAXHOSTNAMELEN + 1];
+	uint64_t last;		/* start of the last request */
+	int unknown;		/* the name does not resolve */
+	TAILQ_HEAD(, crawl_channel) channels;
+	TAILQ_ENTRY(crawl_host) entry;
+	LIST_ENTRY(crawl_host) bucket;
+};
+
+static TAILQ_HEAD(, crawl_host) crawl_hosts =
+    TAILQ_HEAD_INITIALIZER(crawl_hosts);
+static LIST_HEAD(, crawl_host) crawl_table[CRAWL_BUCKETS];
+
+static void *
+crawl_alloc(size_t size)
+{
+	void *p;
+
+	if ((p = calloc(1, size)) == NULL) {
+		fprintf(stderr, "%s: %s\n", __func__, strerror(errno));
+		exit(1);
+	}
+	return (p);
+}
+
+static struct crawl_host *
+crawl_host(const char *link)
+{
+	struct crawl_host *host;
+	struct url *url;
+	char name[MAXHOSTNAMELEN + 1] = "";
+	uint32_t hash = 2166136261U;
+	char *p;
+
+	/* invalid links end up together, fetch_channel() reports them */
+	if ((url = fetchParseURL(link)) != NULL) {
+		/* IPv6 literal in brackets, getaddrinfo() wants it bare */
+		if (url->host[0] == '[')
+			snprintf(name, sizeof(name), "%.*s",
+			    (int)strcspn(url->host + 1, "]"), url->host + 1);
+		else
+			snprintf(name, sizeof(name), "%s", url->host);
+		fetchFreeURL(url);
+	}
+	for (p = name; *p; p++) {
+		*p = tolower((unsigned char)*p);
+		hash = (hash ^ (unsigned char)*p) * 16777619U;
+	}
+	hash &= CRAWL_BUCKETS - 1;
+	LIST_FOREACH(host, &crawl_table[hash], bucket) {
+		if (strcmp(host->name, name) == 0)
+			return (host);
+	}
+	host = crawl_alloc(sizeof(struct crawl_host));
+	snprintf(host->name, sizeof(host->name), "%s", name);
+	TAILQ_INIT(&host->channels);
+	TAILQ_INSERT_TAIL(&crawl_hosts, host, entry);
+	LIST_INSERT_HEAD(&crawl_table[hash], host, bucket);
+	return (host);
+}
+
+/* class of the libfetch error code */
+const char *
+crawl_error(int code)
+{
+	switch (code) {
+	case FETCH_RESOLV:
+		return ("resolve");
+	case FETCH_TIMEOUT:
+		return ("timeout");
+	case FETCH_DOWN:
+	case FETCH_NETWORK:
+		return ("network");
+	case FETCH_UNAVAIL:
+		return ("unavailable");
+	case FETCH_AUTH:
+		return ("auth");
+	case FETCH_TEMP:
+		return ("temporary");
+	case FETCH_PROTO:
+	case FETCH_SERVER:
+		return ("server");
+	case FETCH_MOVED:
+		return ("moved");
+	case FETCH_URL:
+		return ("url");
+	default:
+		return ("fetch");
+	}
+}
+
+/* record the outcome of the fetch, error is NULL when it worked */
+void
+crawl_result(int id, const char *error, const char *status)
+{
+	time_t retry = 0, delay;
+	int i, failures = 0, same = 0;
+	Stmt q;
+
+	/* a shard sees its own results since the last merge first */
+	if (shard_staging)
+		db_prepare(&q, "SELECT failures, status FROM stage.health "
+				"WHERE chanid = %d "
+				"UNION ALL "
+				"SELECT failures, status FROM channels "
+				"WHERE id = %d", id, id);
+	else
+		db_prepare(&q, "SELECT failures, status FROM channels "
+				"WHERE id = %d", id);
+	if (db_step(&q) == SQLITE_ROW) {
+		failures = db_column_int(&q, 0);
+		same = db_column_text(&q, 1) &&
+		    strcmp(db_column_text(&q, 1), status) == 0;
+	}
+	db_finalize(&q);
+	if (error == NULL) {
+		if (failures == 0 && same)
+			return;
+		failures = 0;
+	} else if (failures == 0 &&
+	    strcmp(error, crawl_error(FETCH_RESOLV)) == 0) {
+		/* no retry yet, the channel is tried again next run */
+		failures = 1;
+		printf("rss id [%d] failed (%s: %s), next try next run.\n",
+		    id, error, status);
+	} else {
+		failures++;
+		delay = CRAWL_BACKOFF;
+		for (i = 1; i < failures && delay < CRAWL_BACKOFF_MAX; i++)
+			delay *= 2;
+		if (delay > CRAWL_BACKOFF_MAX)
+			delay = CRAWL_BACKOFF_MAX;
+		retry = time(NULL) + delay;
+		printf("rss id [%d] failed %d in a row (%s: %s), next try in "
+		    "%ldh.\n", id, failures, error, status,
+		    (long)delay / 3600);
+	}
+	if (shard_staging)
+		db_multi_exec("INSERT OR REPLACE INTO stage.health (chanid, "
+				"failures, error, status, retry) "
+				"VALUES (%d, %d, %Q, %Q, %ld)",
+				id, failures, error, status, (long)retry);
+	else
+		db_multi_exec("UPDATE channels SET failures = %d, error = %Q, "
+				"status = %Q, retry = %ld WHERE id = %d",
+				failures, error, status, (long)retry, id);
+}
+
+/* queue channel for the run */
+void
+crawl_add(int id, time_t modified, const char *link, long tagid)
+{
+	struct crawl_channel *chan;
+	struct crawl_host *host;
+
+	chan = crawl_alloc(sizeof(struct crawl_channel));
+	chan->id = id;
+	chan->modified = modified;
+	if ((chan->link = strdup(link ? link : "")) == NULL) {
+		fprintf(stderr, "%s: %s\n", __func__, strerror(errno));
+		exit(1);
+	}
+	chan->tagid = tagid;
+	host = crawl_host(chan->link);
+	TAILQ_INSERT_TAIL(&host->channels, chan, entry);
+}
+
+struct crawl_resolver {
+	pthread_mutex_t lock;
+	struct crawl_host *next;
+};
+
+static void *
+crawl_resolve_thread(void *arg)
+{
+	struct crawl_resolver *resolver = arg;
+	struct addrinfo hints, *res;
+	struct crawl_host *host;
+	int rc;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	for (;;) {
+		pthread_mutex_lock(&resolver->lock);
+		if ((host = resolver->next) != NULL)
+			resolver->next = TAILQ_NEXT(host, entry);
+		pthread_mutex_unlock(&resolver->lock);
+		if (host == NULL)
+			break;
+		if (host->name[0] == 0)
+			continue;
+		if ((rc = getaddrinfo(host->name, NULL, &hints, &res)) == 0) {
+			freeaddrinfo(res);
+			continue;
+		}
+		/* temporary failures are left to fetchXGet() */
+		dmsg(0, "%s: %s: %s", __func__, host->name, gai_strerror(rc));
+		if (rc == EAI_NONAME)
+			host->unknown = 1;
+	}
+	return (NULL);
+}
+
+/* resolve the hosts of the queued channels using threads */
+void
+crawl_resolve(int threads)
+{
+	struct crawl_resolver resolver;
+	struct crawl_host *host;
+	pthread_t *tid;
+	uint64_t start = metrics_now();
+	int i, count = 0;
+
+	TAILQ_FOREACH(host, &crawl_hosts, entry)
+		count++;
+	metrics_add(M_HOSTS, count);
+	if (threads > count)
+		threads = count;
+	if (threads < 1)
+		return;
+	dmsg(0, "%s: %d hosts, %d threads", __func__, count, threads);
+	pthread_mutex_init(&resolver.lock, NULL);
+	resolver.next = TAILQ_FIRST(&crawl_hosts);
+	tid = crawl_alloc(threads * sizeof(pthread_t));
+	for (i = 0; i < threads; i++) {
+		if (pthread_create(&tid[i], NULL, crawl_resolve_thread,
+		    &resolver) != 0) {
+			fprintf(stderr, "%s: cannot create thread\n", __func__);
+			break;
+		}
+	}
+	while (i-- > 0)
+		pthread_join(tid[i], NULL);
+	free(tid);
+	pthread_mutex_destroy(&resolver.lock);
+	TAILQ_FOREACH(host, &crawl_hosts, entry) {
+		if (host->unknown)
+			metrics_add(M_HOSTS_UNRESOLVED, 1);
+	}
+	metrics_time(T_RESOLVE, start);
+}
+
+/* fetch all queued channels, delay in ms between requests to a host */
+void
+crawl_run(int delay)
+{
+	struct crawl_channel *chan;
+	struct crawl_host *host, *next;
+	uint64_t now, wait, ready;
+	struct timespec ts;
+
+	wait = (uint64_t)delay * 1000;
+	while (!TAILQ_EMPTY(&crawl_hosts)) {
+		ready = UINT64_MAX;
+		for (host = TAILQ_FIRST(&crawl_hosts); host; host = next) {
+			next = TAILQ_NEXT(host, entry);
+			now = metrics_now();
+			if (host->last && now - host->last < wait) {
+				if (host->last + wait < ready)
+					ready = host->last + wait;
+				continue;
+			}
+			chan = TAILQ_FIRST(&host->channels);
+			TAILQ_REMOVE(&host->channels, chan, entry);
+			if (host->unknown) {
+				dmsg(0, "%s: unknown host %s", __func__,
+				    chan->link);
+				metrics_add(M_CHANNELS, 1);
+				metrics_add(M_CHANNELS_FAILED, 1);
+				crawl_result(chan->id,
+				    crawl_error(FETCH_RESOLV), "unknown host");
+			} else {
+				host->last = now;
+				if (fetch_channel(chan->id, chan->modified,
+				    chan->link) > 0)
+					summary_mark(chan->tagid);
+			}
+			free(chan->link);
+			free(chan);
+			if (TAILQ_EMPTY(&host->channels)) {
+				TAILQ_REMOVE(&crawl_hosts, host, entry);
+				LIST_REMOVE(host, bucket);
+				free(host);
+			}
+			ready = 0;
+		}
+		/* every host left has been hit too recently */
+		if (ready != 0 && ready != UINT64_MAX &&
+		    (now = metrics_now()) < ready) {
+			dmsg(0, "%s: waiting %llu ms", __func__,
+			    (unsigned long long)(ready - now) / 1000);
+			ts.tv_sec = (ready - now) / 1000000;
+			ts.tv_nsec = (ready - now) % 1000000 * 1000;
+			nanosleep(&ts, NULL);
+		}
+	}
+}
@@ -0,0 +1,404 @@
+/*
+ * Copyright (c) 2026 Nikola Kolev <koue@chaosophia.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <fslbase.h>
+
+#include "rss.h"
+
+/*
+ * Append the text content of html into out. Tags, comments and entities
+ * are replaced with a single space, runs of white space are collapsed.
+ */
+void
+html_text(Blob *out, const char *html)
+{
+	const char *p, *start;
+	int space = 1;
+
+	for (p = html; p && *p; p++) {
+		if (*p == '<') {
+			if (strncmp(p, "<!--", 4) == 0) {
+				if ((p = strstr(p + 4, "-->")) == NULL)
+					break;
+				p += 2;
+			} else if ((p = strchr(p, '>')) == NULL) {
+				break;
+			}
+		} else if (*p == '&') {
+			for (start = p++; isalnum((unsigned char)*p) ||
+			    *p == '#'; p++)
+				;
+			if (*p != ';') {
+				/* not an entity, keep it */
+				p = start;
+				blob_append(out, p, 1);
+				space = 0;
+				continue;
+			}
+		} else if (!isspace((unsigned char)*p)) {
+			for (start = p; *p && *p != '<' && *p != '&' &&
+			    !isspace((unsigned char)*p); p++)
+				;
+			blob_append(out, start, p - start);
+			space = 0;
+			p--;
+			continue;
+		}
+		if (space == 0) {
+			blob_append(out, " ", 1);
+			space = 1;
+		}
+	}
+}
+
+/* elements dropped together with their content */
+static const char *html_drop[] = {
+	"applet", "embed", "head", "iframe", "math", "noscript", "object",
+	"script", "style", "svg", "template", "textarea", "title", NULL
+};
+
+/* elements kept, all others are dropped leaving their content */
+static const char *html_allow[] = {
+	"a", "abbr", "b", "blockquote", "br", "cite", "code", "dd", "del",
+	"div", "dl", "dt", "em", "figcaption", "figure", "h1", "h2", "h3",
+	"h4", "h5", "h6", "hr", "i", "img", "ins", "li", "ol", "p", "pre",
+	"q", "s", "small", "span", "strong", "sub", "sup", "table", "tbody",
+	"td", "tfoot", "th", "thead", "tr", "u", "ul", NULL
+};
+
+/* tag/attribute pairs kept, "*" stands for any allowed tag */
+static const char *html_attrs[][2] = {
+	{ "*", "title" },
+	{ "a", "href" },
+	{ "blockquote", "cite" },
+	{ "img", "align" }, { "img", "alt" }, { "img", "border" },
+	{ "img", "height" }, { "img", "hspace" }, { "img", "src" },
+	{ "img", "vspace" }, { "img", "width" },
+	{ "ol", "start" },
+	{ "q", "cite" },
+	{ "td", "colspan" }, { "td", "rowspan" },
+	{ "th", "colspan" }, { "th", "rowspan" },
+	{ NULL, NULL }
+};
+
+static int
+html_listed(const char **list, const char *name)
+{
+	for (; *list; list++) {
+		if (strcmp(*list, name) == 0)
+			return (1);
+	}
+	return (0);
+}
+
+static int
+html_attr_allowed(const char *tag, const char *attr)
+{
+	int i;
+
+	for (i = 0; html_attrs[i][0]; i++) {
+		if ((strcmp(html_attrs[i][0], "*") == 0 ||
+		    strcmp(html_attrs[i][0], tag) == 0) &&
+		    strcmp(html_attrs[i][1], attr) == 0)
+			return (1);
+	}
+	return (0);
+}
+
+/*
+ * Only relative, http(s) and mailto links are kept. The scheme may not
+ * contain entities, white space or anything the browser could decode
+ * into javascript:.
+ */
+static int
+html_url_safe(const char *p, size_t len)
+{
+	size_t n;
+
+	for (n = 0; n < len; n++) {
+		if (p[n] == '/' || p[n] == '?' || p[n] == '#')
+			return (1);
+		if (p[n] == ':')
+			break;
+		if (!isalnum((unsigned char)p[n]) && p[n] != '.' &&
+		    p[n] != '-' && p[n] != '_' && p[n] != '%')
+			return (0);
+	}
+	if (n == len)
+		return (1);
+	return ((n == 4 && strncasecmp(p, "http", 4) == 0) ||
+	    (n == 5 && strncasecmp(p, "https", 5) == 0) ||
+	    (n == 6 && strncasecmp(p, "mailto", 6) == 0));
+}
+
+/*
+ * Append the attribute value escaped for double quotes. Entities are
+ * kept, the browser decodes them the same way; any other '&' is escaped.
+ */
+static void
+html_value(Blob *out, const char *p, size_t len)
+{
+	size_t n, i;
+
+	for (n = 0; n < len; n++) {
+		switch (p[n]) {
+		case '"':
+			blob_append(out, "&quot;", 6);
+			break;
+		case '<':
+			blob_append(out, "&lt;", 4);
+			break;
+		case '>':
+			blob_append(out, "&gt;", 4);
+			break;
+		case '&':
+			for (i = n + 1; i < len &&
+			    (isalnum((unsigned char)p[i]) || p[i] == '#'); i++)
+				;
+			if (i == n + 1 || i == len || p[i] != ';')
+				blob_append(out, "&amp;", 5);
+			else
+				blob_append(out, "&", 1);
+			break;
+		default:
+			blob_append(out, p + n, 1);
+		}
+	}
+}
+
+/* append attribute as name="value" if it is allowed for the tag */
+static void
+html_attribute(Blob *out, const char *tag, const char *attr, size_t attrlen,
+    const char *value, size_t valuelen, int *width, int *height)
+{
+	char lower[16];
+	size_t n;
+
+	if (attrlen == 0 || attrlen >= sizeof(lower))
+		return;
+	for (n = 0; n < attrlen; n++)
+		lower[n] = tolower((unsigned char)attr[n]);
+	lower[n] = 0;
+	if (!html_attr_allowed(tag, lower))
+		return;
+	if ((strcmp(lower, "href") == 0 || strcmp(lower, "src") == 0 ||
+	    strcmp(lower, "cite") == 0) &&
+	    (value == NULL || !html_url_safe(value, valuelen)))
+		return;
+	if (value && strcmp(lower, "width") == 0)
+		*width = atoi(value);
+	else if (value && strcmp(lower, "height") == 0)
+		*height = atoi(value);
+	if (out == NULL)
+		return;
+	blob_append(out, " ", 1);
+	blob_append(out, lower, attrlen);
+	if (value) {
+		blob_append(out, "=\"", 2);
+		html_value(out, value, valuelen);
+		blob_append(out, "\"", 1);
+	}
+}
+
+/*
+ * Tokenize the attributes of the tag, p points after its name, the way an
+ * HTML5 browser does: a quote starts a quoted value only right after '=',
+ * an unquoted value ends at white space or '>'. The allowed attributes
+ * are appended into out (unless NULL) as name="value", other bytes of
+ * the tag never reach it. Returns the closing '>', NULL when the tag is
+ * not closed. *pixel is set for the tracking pixels.
+ */
+static const char *
+html_attributes(Blob *out, const char *name, const char *p, int *pixel)
+{
+	const char *attr, *value;
+	size_t attrlen, valuelen;
+	int width = -1, height = -1, selfclose = 0;
+	char quote;
+
+	for (;;) {
+		for (; isspace((unsigned char)*p) || *p == '/'; p++)
+			selfclose = (*p == '/' && p[1] == '>');
+		if (*p == '>' || *p == 0)
+			break;
+		/* a leading '=' is part of the name */
+		for (attr = p++; *p && *p != '=' && *p != '/' && *p != '>' &&
+		    !isspace((unsigned char)*p); p++)
+			;
+		attrlen = p - attr;
+		value = NULL;
+		valuelen = 0;
+		while (isspace((unsigned char)*p))
+			p++;
+		if (*p == '=') {
+			for (p++; isspace((unsigned char)*p); p++)
+				;
+			if (*p == '"' || *p == '\'') {
+				quote = *p;
+				for (value = ++p; *p && *p != quote; p++)
+					;
+				if (*p == 0)
+					return (NULL);
+				valuelen = p++ - value;
+			} else {
+				for (value = p; *p && *p != '>' &&
+				    !isspace((unsigned char)*p); p++)
+					;
+				valuelen = p - value;
+			}
+		}
+		html_attribute(out, name, attr, attrlen, value, valuelen,
+		    &width, &height);
+	}
+	if (*p == 0)
+		return (NULL);
+	if (out && selfclose)
+		blob_append(out, " /", 2);
+	if (pixel)
+		*pixel = (strcmp(name, "img") == 0 && width >= 0 &&
+		    width <= 1 && height >= 0 && height <= 1);
+	return (p);
+}
+
+/*
+ * Append html into out keeping only the allowed elements and attributes.
+ * Scripts, styles, embedded objects, comments and tracking pixels are
+ * removed, text and entities are copied unchanged.
+ */
+void
+html_sanitize(Blob *out, const char *html)
+{
+	Blob tag = empty_blob;
+	const char *p, *start, *end;
+	char name[16];
+	int closing, pixel;
+	size_t n;
+
+	for (p = html; p && *p; p = end + 1) {
+		if (*p != '<') {
+			for (start = p; *p && *p != '<'; p++)
+				;
+			blob_append(out, start, p - start);
+			if (*p == 0)
+				break;
+		}
+		start = p++;
+		if (strncmp(p, "!--", 3) == 0) {
+			if ((end = strstr(p + 3, "-->")) == NULL)
+				break;
+			end += 2;
+			continue;
+		}
+		if ((closing = (*p == '/')))
+			p++;
+		if (*p == '!' || *p == '?') {
+			/* doctype, processing instruction */
+			if ((end = strchr(p, '>')) == NULL)
+				break;
+			continue;
+		}
+		if (!isalpha((unsigned char)*p)) {
+			blob_append(out, "&lt;", 4);
+			end = start;
+			continue;
+		}
+		for (n = 0; isalnum((unsigned char)*p); p++) {
+			if (n < sizeof(name) - 1)
+				name[n++] = tolower((unsigned char)*p);
+		}
+		name[n] = 0;
+		if (html_listed(html_drop, name)) {
+			if ((end = html_attributes(NULL, name, p, NULL)) == NULL)
+				break;
+			if (closing || end[-1] == '/')
+				continue;
+			/* skip up to the matching end tag */
+			for (p = end; (p = strstr(p, "</")) != NULL; p += 2) {
+				if (strncasecmp(p + 2, name, n) == 0 &&
+				    !isalnum((unsigned char)p[2 + n]))
+					break;
+			}
+			if (p == NULL || (end = html_attributes(NULL, name,
+			    p + 2 + n, NULL)) == NULL)
+				break;
+			continue;
+		}
+		if (!html_listed(html_allow, name) || closing) {
+			/* the attributes of an end tag are ignored */
+			if ((end = html_attributes(NULL, name, p, NULL)) == NULL)
+				break;
+			if (closing && html_listed(html_allow, name)) {
+				blob_append(out, start, p - start);
+				blob_append(out, ">", 1);
+			}
+			continue;
+		}
+		blob_append(&tag, start, p - start);
+		if ((end = html_attributes(&tag, name, p, &pixel)) == NULL) {
+			blob_reset(&tag);
+			break;
+		}
+		if (!pixel) {
+			blob_append(&tag, ">", 1);
+			blob_append(out, blob_buffer(&tag), blob_size(&tag));
+		}
+		blob_reset(&tag);
+	}
+}
+
+/*
+ * Append a summary of text (see html_text()) of at most len bytes, cut
+ * at a word boundary.
+ */
+void
+html_summary(Blob *out, const char *text, size_t len)
+{
+	size_t n;
+
+	if ((n = strlen(text)) <= len) {
+		blob_append(out, text, n);
+		return;
+	}
+	for (n = len; n > 0 && text[n] != ' '; n--)
+		;
+	if (n == 0) {
+		/* a single long word, do not split a character */
+		for (n = len; n > 0 && (text[n] & 0xc0) == 0x80; n--)
+			;
+	}
+	blob_append(out, text, n);
+	blob_append(out, " ...", 4);
+}
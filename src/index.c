@@ -33,6 +33,7 @@
 #include <render.h>
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <fslbase.h>
 #include <fsldb.h>
 #include <sqlite3.h>
@@ -41,9 +42,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/file.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
+#include <zlib.h>
 
 #include "rss.h"
 
@@ -65,10 +69,134 @@ Global g;
 static long		query_array[3] = { -1, 1, 0 };
 static unsigned long	callback_result = 0;
 
+/*
+** search:
+**
+** QUERY_STRING: q=<terms>[&o=<offset>]
+**
+** search_terms holds the decoded terms, search_match the fts5 expression.
+** Only the newest SEARCH_WINDOW matches are ranked, the cost of the query
+** doesn't depend on the size of the archive.
+*/
+#define	SEARCH_WINDOW	1000
+static char		search_terms[128];
+static char		search_match[512];
+
+/*
+** trace:
+**
+** Monotonic time spent in every phase of the request and the counters of
+** every SQL statement. Requests slower than 'slowms' (default 100) are
+** appended to 'slowlog' when set in the config.
+*/
+#define	TRACE_MAX	16
+static struct trace {
+	const char	*name;
+	uint64_t	usec;
+	int		stmt;
+	int		fullscan;
+	int		sort;
+	int		autoindex;
+	int		vmstep;
+} trace[TRACE_MAX];
+static int		trace_count = 0;
+static uint64_t		trace_start = 0;
+static char		trace_query[400];	/* parsing modifies the original */
+
 static struct		render render;
 static struct 		queue config;
 static const char *params[] = { "tag", "feeds", "ct_html", "dbpath",
     "htmldir", "name", "owner", "url", "webtheme", NULL };
+static long		config_feeds;
+
+/*
+** snapshot:
+**
+** index.cgi --snapshot writes the checked config and the rendered tag
+** navigation into SNAPSHOT_FILE, next to the config file. The requests
+** map it read-only instead of parsing the config and querying the tags.
+** It is used only while the config file has the size, mtime and inode
+** it was made from, otherwise the config is parsed as before. Run it
+** again after the tags are changed.
+*/
+#define	SNAPSHOT_FILE		CONFFILE ".snap"
+#define	SNAPSHOT_TEST		"rssrolltest.snap"	/* --valgrind */
+#define	SNAPSHOT_MAGIC		"rrsnap"
+#define	SNAPSHOT_VERSION	1
+static const char *snapshot_keys[] = { "tag", "feeds", "ct_html", "dbpath",
+    "htmldir", "name", "owner", "url", "webtheme", "gzip", "slowlog",
+    "slowms", "cache", NULL };
+#define	SNAPSHOT_KEYS		13
+
+struct snapshot {
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	size;			/* of the whole file */
+	int64_t		conf_size;		/* of the config file */
+	int64_t		conf_mtime;
+	uint64_t	conf_ino;
+	int64_t		feeds;
+	uint32_t	value[SNAPSHOT_KEYS];	/* string offsets, 0 unset */
+	uint32_t	tags;			/* offset of the tags html */
+	uint32_t	tags_len;
+};
+static const struct snapshot	*snapshot = NULL;
+static size_t			snapshot_size;
+
+static const char *
+config_get(const char *name)
+{
+	int i;
+
+	if (snapshot == NULL)
+		return (queue_get(&config, name));
+	for (i = 0; snapshot_keys[i]; i++) {
+		if (strcmp(snapshot_keys[i], name) == 0)
+			return (snapshot->value[i] ?
+			    (const char *)snapshot + snapshot->value[i] : NULL);
+	}
+	return (NULL);
+}
+
+/* map the snapshot if it was made from the current config file */
+static void
+snapshot_open(const char *fn, const char *conffile)
+{
+	const struct snapshot *snap;
+	struct stat conf, st;
+	void *map;
+	int fd, i;
+
+	if (stat(conffile, &conf) == -1 || (fd = open(fn, O_RDONLY)) == -1)
+		return;
+	if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(*snap) ||
+	    (map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) ==
+	    MAP_FAILED) {
+		close(fd);
+		return;
+	}
+	close(fd);
+	snap = map;
+	if (memcmp(snap->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 ||
+	    snap->version != SNAPSHOT_VERSION ||
+	    snap->size != (uint64_t)st.st_size ||
+	    ((const char *)map)[st.st_size - 1] != 0 ||
+	    snap->conf_size != (int64_t)conf.st_size ||
+	    snap->conf_mtime != (int64_t)conf.st_mtime ||
+	    snap->conf_ino != (uint64_t)conf.st_ino ||
+	    snap->tags >= snap->size || snap->tags_len >= snap->size - snap->tags)
+		goto stale;
+	for (i = 0; i < SNAPSHOT_KEYS; i++) {
+		if (snap->value[i] >= snap->size)
+			goto stale;
+	}
+	snapshot = snap;
+	snapshot_size = st.st_size;
+	config_feeds = snap->feeds;
+	return;
+stale:
+	munmap(map, st.st_size);
+}
 
 static int
 query_parse(char *str)
@@ -123,6 +251,328 @@ query_string_validate(char *str)
 	return (0);
 }
 
+static uint64_t
+trace_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
+/* record phase which started at since, returns current time */
+static uint64_t
+trace_phase(const char *name, uint64_t since)
+{
+	uint64_t now = trace_now();
+
+	if (trace_count < TRACE_MAX) {
+		memset(&trace[trace_count], 0, sizeof(struct trace));
+		trace[trace_count].name = name;
+		trace[trace_count].usec = now - since;
+		trace_count++;
+	}
+	return (now);
+}
+
+/* record statement before it gets finalized */
+static void
+trace_stmt(const char *name, Stmt *q, uint64_t since)
+{
+	struct trace *t = &trace[trace_count];
+
+	if (trace_count == TRACE_MAX)
+		return;
+	trace_phase(name, since);
+	t->stmt = 1;
+	t->fullscan = sqlite3_stmt_status(q->pStmt,
+	    SQLITE_STMTSTATUS_FULLSCAN_STEP, 0);
+	t->sort = sqlite3_stmt_status(q->pStmt, SQLITE_STMTSTATUS_SORT, 0);
+	t->autoindex = sqlite3_stmt_status(q->pStmt,
+	    SQLITE_STMTSTATUS_AUTOINDEX, 0);
+	t->vmstep = sqlite3_stmt_status(q->pStmt, SQLITE_STMTSTATUS_VM_STEP, 0);
+}
+
+/* append the request into the slow log, a single write per request */
+static void
+trace_log(void)
+{
+	const char *slowlog = config_get("slowlog");
+	const char *slowms = config_get("slowms");
+	uint64_t total = trace_now() - trace_start;
+	Blob line = empty_blob;
+	char stamp[32];
+	time_t now;
+	char *p;
+	int fd, i;
+
+	if (slowlog == NULL)
+		return;
+	if (total < (uint64_t)(slowms ? strtol(slowms, NULL, 10) : 100) * 1000)
+		return;
+	for (p = trace_query; *p; p++) {
+		if (*p < ' ' || *p == '"')
+			*p = '?';
+	}
+	now = time(NULL);
+	strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+	blob_appendf(&line, "%s total=%.3fms query=\"%s\"", stamp,
+	    total / 1000.0, trace_query);
+	for (i = 0; i < trace_count; i++) {
+		blob_appendf(&line, " %s=%.3fms", trace[i].name,
+		    trace[i].usec / 1000.0);
+		if (trace[i].stmt) {
+			blob_appendf(&line, "[fullscan=%d,sort=%d,autoindex=%d,"
+			    "vmstep=%d]", trace[i].fullscan, trace[i].sort,
+			    trace[i].autoindex, trace[i].vmstep);
+		}
+	}
+	blob_append(&line, "\n", 1);
+	if ((fd = open(slowlog, O_WRONLY | O_APPEND | O_CREAT, 0660)) != -1) {
+		write(fd, blob_buffer(&line), blob_size(&line));
+		close(fd);
+	}
+	blob_reset(&line);
+}
+
+static int
+search_hex(int c)
+{
+	if (c >= '0' && c <= '9')
+		return (c - '0');
+	if (c >= 'a' && c <= 'f')
+		return (c - 'a' + 10);
+	if (c >= 'A' && c <= 'F')
+		return (c - 'A' + 10);
+	return (-1);
+}
+
+/* url decode value into dst, returns -1 if it doesn't fit */
+static int
+search_decode(char *dst, size_t size, const char *value, size_t len)
+{
+	size_t i, n = 0;
+
+	for (i = 0; i < len; i++) {
+		if (n + 1 >= size)
+			return (-1);
+		if (value[i] == '+') {
+			dst[n++] = ' ';
+		} else if (value[i] == '%' && i + 2 < len &&
+		    search_hex(value[i + 1]) != -1 &&
+		    search_hex(value[i + 2]) != -1) {
+			dst[n++] = search_hex(value[i + 1]) * 16 +
+			    search_hex(value[i + 2]);
+			i += 2;
+		} else {
+			dst[n++] = value[i];
+		}
+	}
+	dst[n] = 0;
+	return (0);
+}
+
+/* every word of the terms becomes a quoted fts5 string */
+static int
+search_build(void)
+{
+	unsigned char *p = (unsigned char *)search_terms;
+	size_t n = 0;
+
+	while (*p) {
+		if (!isalnum(*p) && *p < 0x80) {
+			p++;
+			continue;
+		}
+		if (n + 4 >= sizeof(search_match))
+			return (-1);
+		search_match[n++] = '"';
+		while ((isalnum(*p) || *p >= 0x80) &&
+		    (n + 3 < sizeof(search_match)))
+			search_match[n++] = *p++;
+		search_match[n++] = '"';
+		search_match[n++] = ' ';
+	}
+	search_match[n] = 0;
+	return (n ? 0 : -1);
+}
+
+static int
+search_parse(char *str)
+{
+	char *key, *value;
+
+	if (strlen(str) > 384)
+		goto fail;
+	while ((key = strsep(&str, "&")) != NULL) {
+		if ((value = strchr(key, '=')) == NULL)
+			goto fail;
+		*value++ = 0;
+		if (strcmp(key, "q") == 0) {
+			if (search_decode(search_terms, sizeof(search_terms),
+			    value, strlen(value)) == -1)
+				goto fail;
+		} else if (strcmp(key, "o") == 0) {
+			query_array[2] = strtol(value, NULL, 10);
+			if (query_array[2] < 0)
+				goto fail;
+		} else {
+			goto fail;
+		}
+	}
+	if (search_build() == 0)
+		return (0);
+fail:
+	printf("Status: 400\r\n\r\nYou are trying to send wrong query!\n");
+	fflush(stdout);
+	return (-1);
+}
+
+/* print link to the search results starting at offset */
+static void
+search_link(long offset)
+{
+	unsigned char *p;
+
+	printf("<a href='%s?q=", config_get("url"));
+	for (p = (unsigned char *)search_terms; *p; p++) {
+		if (isalnum(*p))
+			putchar(*p);
+		else
+			printf("%%%02X", *p);
+	}
+	printf("&amp;o=%ld'>", offset);
+}
+
+/* gzip the page if enabled in the config and accepted by the client */
+static int
+gzip_accepted(void)
+{
+	const char *gzip = config_get("gzip");
+	const char *accept = getenv("HTTP_ACCEPT_ENCODING");
+
+	return (gzip && strcmp(gzip, "1") == 0 && accept &&
+	    strstr(accept, "gzip"));
+}
+
+/* the plain and the gzip page are different entries of a cache */
+static void
+gzip_vary(void)
+{
+	const char *gzip = config_get("gzip");
+
+	if (gzip && strcmp(gzip, "1") == 0)
+		printf("\r\nVary: Accept-Encoding");
+}
+
+static void
+gzip_write(FILE *out, const char *page, size_t len)
+{
+	unsigned char buf[16384];
+	z_stream z;
+	int rc;
+
+	memset(&z, 0, sizeof(z));
+	/* 16 + MAX_WBITS: gzip header */
+	if (deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS,
+	    8, Z_DEFAULT_STRATEGY) != Z_OK)
+		return;
+	z.next_in = (unsigned char *)page;
+	z.avail_in = len;
+	do {
+		z.next_out = buf;
+		z.avail_out = sizeof(buf);
+		rc = deflate(&z, Z_FINISH);
+		fwrite(buf, 1, sizeof(buf) - z.avail_out, out);
+	} while (rc == Z_OK);
+	deflateEnd(&z);
+}
+
+/*
+ * HTTP caching, enabled with cache=<max-age> in the config.
+ *
+ * The validator comes from stat(2) of the database (and its WAL), the
+ * config file, the snapshot and the templates: the pages change only
+ * when the crawler writes, the config or the snapshot is replaced or the
+ * templates are edited. The modification times are taken with their
+ * nanoseconds, two writes within a second differ. The gzip encoded page
+ * has its own ETag. A conditional request which matches is answered
+ * with 304 before the database is opened.
+ */
+static char		cache_etag[64];
+static char		cache_date[64];
+
+static void
+cache_stat(const char *fn, time_t *modified, uint64_t *hash)
+{
+	struct stat st;
+
+	if (stat(fn, &st) == -1)
+		return;
+	if (st.st_mtime > *modified)
+		*modified = st.st_mtime;
+	*hash = (*hash ^ (uint64_t)st.st_mtime) * 0x100000001b3ULL;
+	*hash = (*hash ^ (uint64_t)st.st_mtim.tv_nsec) * 0x100000001b3ULL;
+	*hash = (*hash ^ (uint64_t)st.st_size) * 0x100000001b3ULL;
+	*hash = (*hash ^ (uint64_t)st.st_ino) * 0x100000001b3ULL;
+}
+
+/* returns 1 if the copy of the client is still fresh */
+static int
+cache_check(const char *conffile, const char *snapfile)
+{
+	static const char *templates[] = { "main.html", "%s/header.html",
+	    "%s/footer.html", "%s/feed.html", NULL };
+	const char *htmldir = config_get("htmldir");
+	const char *theme = config_get("webtheme");
+	const char *match, *since;
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	time_t modified = 0;
+	char fn[256], name[64];
+	struct tm tm;
+	int i;
+
+	cache_stat(config_get("dbpath"), &modified, &hash);
+	snprintf(fn, sizeof(fn), "%s-wal", config_get("dbpath"));
+	cache_stat(fn, &modified, &hash);
+	cache_stat(conffile, &modified, &hash);
+	cache_stat(snapfile, &modified, &hash);
+	for (i = 0; templates[i]; i++) {
+		snprintf(name, sizeof(name), templates[i], theme);
+		snprintf(fn, sizeof(fn), "%s/%s", htmldir, name);
+		cache_stat(fn, &modified, &hash);
+	}
+	snprintf(cache_etag, sizeof(cache_etag), "W/\"%lx-%llx%s\"",
+	    (long)modified, (unsigned long long)hash,
+	    gzip_accepted() ? "-gz" : "");
+	strftime(cache_date, sizeof(cache_date), "%a, %d %b %Y %H:%M:%S GMT",
+	    gmtime(&modified));
+
+	/* If-None-Match wins over If-Modified-Since */
+	if ((match = getenv("HTTP_IF_NONE_MATCH")) != NULL)
+		return (strstr(match, cache_etag) != NULL ||
+		    strcmp(match, "*") == 0);
+	if ((since = getenv("HTTP_IF_MODIFIED_SINCE")) != NULL) {
+		memset(&tm, 0, sizeof(tm));
+		if (strptime(since, "%a, %d %b %Y %H:%M:%S GMT", &tm) != NULL)
+			return (modified <= timegm(&tm));
+	}
+	return (0);
+}
+
+/* validator headers, empty when caching is off */
+static void
+cache_headers(void)
+{
+	const char *maxage = config_get("cache");
+
+	if (maxage == NULL || cache_etag[0] == 0)
+		return;
+	printf("\r\nETag: %s\r\nLast-Modified: %s\r\n"
+	    "Cache-Control: public, max-age=%ld",
+	    cache_etag, cache_date, strtol(maxage, NULL, 10));
+}
+
 static void
 render_error(const char *fmt, ...)
 {
@@ -158,22 +608,47 @@ render_items_list(const char *macro, void *arg)
 	struct pool *pool;
 	struct item *item;
 	Blob sql = empty_blob;
+	uint64_t start = trace_now();
 
+	if (search_match[0]) { // show search results
+		blob_append_sql(&sql, "SELECT "
+		    "    f.id, f.modified, f.link, f.title, COALESCE(f.summary, f.description), f.pubdate, f.chanid, "
+		    "    c.title, c.site "
+		    "FROM "
+		    "    (SELECT rowid, bm25(feeds_fts, 10.0, 1.0) AS score "
+		    "     FROM feeds_fts WHERE feeds_fts MATCH %Q "
+		    "     ORDER BY rowid DESC LIMIT %d) AS s "
+		    "    JOIN feeds AS f ON f.id = s.rowid "
+		    "    LEFT JOIN channels AS c ON c.id = f.chanid "
+		    "WHERE f.duplicate IS NULL OR NOT EXISTS "
+		    "    (SELECT 1 FROM feeds WHERE id = f.duplicate) "
+		    "ORDER BY s.score, f.id DESC LIMIT '%ld', '%ld'",
+		    search_match, SEARCH_WINDOW, query_array[2], config_feeds);
+		goto prepare;
+	}
+	/* channel title and site come along, no lookup per item */
 	blob_append_sql(&sql, "SELECT "
-	                      "    id, modified, link, title, description, pubdate, chanid "
+	                      "    f.id, f.modified, f.link, f.title, COALESCE(f.summary, f.description), f.pubdate, f.chanid, "
+	                      "    c.title, c.site "
 		              "FROM "
-		              "    feeds "
+		              "    feeds AS f "
+		              "    LEFT JOIN channels AS c ON c.id = f.chanid "
 		              "WHERE ");
 	if (query_array[0] == 0) { // show single channel
-		blob_append_sql(&sql, "chanid = '%ld' ", query_array[1]);
+		blob_append_sql(&sql, "f.chanid = '%ld' ", query_array[1]);
 	} else { // show tag
-		blob_append_sql(&sql, "chanid IN (select id from channels where tagid = '%ld') ",
+		blob_append_sql(&sql, "f.chanid IN (select id from channels where tagid = '%ld') ",
+		    query_array[1]);
+		/* near duplicates of the items shown */
+		blob_append_sql(&sql, "AND (f.duplicate IS NULL OR NOT EXISTS "
+		    "(SELECT 1 FROM feeds AS o JOIN channels AS oc ON oc.id = o.chanid "
+		    "WHERE o.id = f.duplicate AND oc.tagid = '%ld')) ",
 		    query_array[1]);
 	}
-	blob_append_sql(&sql, "ORDER BY id "
-			      "DESC LIMIT '%ld', '%d'",
-			      query_array[2],
-			      strtol(queue_get(&config, "feeds"), (char **)NULL, 10));
+	blob_append_sql(&sql, "ORDER BY f.id "
+			      "DESC LIMIT '%ld', '%ld'",
+			      query_array[2], config_feeds);
+prepare:
 	db_prepare_blob(&q, &sql);
 	while (db_step(&q)==SQLITE_ROW) {
 		/* PREV option */
@@ -182,12 +657,23 @@ render_items_list(const char *macro, void *arg)
 		item = item_create(pool);
 		item->title = getvalue(pool, db_column_text(&q, 3));
 		item->url = getvalue(pool, db_column_text(&q, 2));
-		item->desc = getvalue(pool, db_column_text(&q, 4));
+		if (db_column_type(&q, 4) == SQLITE_BLOB) {
+			/* inflated while printed */
+			item->desclen = db_column_bytes(&q, 4);
+			item->desc = pool_alloc(pool, item->desclen);
+			memcpy(item->desc, db_column_raw(&q, 4), item->desclen);
+			item->compressed = 1;
+		} else {
+			item->desc = getvalue(pool, db_column_text(&q, 4));
+		}
 		item->date = db_column_int64(&q, 5);
 		item->chanid = db_column_int64(&q, 6);
+		item->channel = getvalue(pool, db_column_text(&q, 7));
+		item->site = getvalue(pool, db_column_text(&q, 8));
 		render_run(&render, "ITEMHTML", (void *)item);
 		pool_free(pool);
 	}
+	trace_stmt(search_match[0] ? "search" : "items", &q, start);
 	db_finalize(&q);
 }
 
@@ -201,10 +687,15 @@ static void
 render_next(const char *macro, void *arg)
 {
 	if (query_array[2]) {
-		long step = query_array[2] - strtol(queue_get(&config, "feeds"), (char **)NULL, 10);
+		long step = query_array[2] - config_feeds;
 		if (step < 0)
 			step = 0;
-		printf("<a href='%s?", queue_get(&config, "url"));
+		if (search_match[0]) {
+			search_link(step);
+			printf(" >>> </a>");
+			return;
+		}
+		printf("<a href='%s?", config_get("url"));
 		if (query_array[0] == 0)
 			printf("0/");
 		printf("%ld/%ld'> >>> </a>", query_array[1], step);
@@ -215,9 +706,14 @@ static void
 render_prev(const char *macro, void *arg)
 {
 	long step = 0;
-	if (callback_result == strtol(queue_get(&config, "feeds"), (char **)NULL, 10)) {
-		step = query_array[2] + strtol(queue_get(&config, "feeds"), (char **)NULL, 10);
-		printf("<a href='%s?", queue_get(&config, "url"));
+	if (callback_result == config_feeds) {
+		step = query_array[2] + config_feeds;
+		if (search_match[0]) {
+			search_link(step);
+			printf(" <<< </a>");
+			return;
+		}
+		printf("<a href='%s?", config_get("url"));
 		if (query_array[0] == 0) {
 			printf("0/");
 		}
@@ -226,19 +722,137 @@ render_prev(const char *macro, void *arg)
 }
 
 static void
-render_tags(const char *macro, void *arg)
+render_search(const char *macro, void *arg)
+{
+	printf("<form method='get' action='%s'>"
+	    "<input type='text' name='q' size='16'> "
+	    "<input type='submit' value='search'></form>",
+	    config_get("url"));
+}
+
+static void
+tags_html(Blob *out)
 {
 	Stmt q;
+	uint64_t start = trace_now();
 
 	db_prepare(&q, "SELECT id, title FROM tags ORDER BY id");
 	while(db_step(&q)==SQLITE_ROW) {
-		printf("<p><a href='%s?%d'>%s</a></p>\n",
-		    queue_get(&config, "url"), db_column_int(&q, 0),
+		blob_appendf(out, "<p><a href='%s?%d'>%s</a></p>\n",
+		    config_get("url"), db_column_int(&q, 0),
 		    db_column_text(&q, 1));
 	}
+	trace_stmt("tags", &q, start);
 	db_finalize(&q);
 }
 
+static void
+render_tags(const char *macro, void *arg)
+{
+	Blob html = empty_blob;
+
+	if (snapshot) {
+		fwrite((const char *)snapshot + snapshot->tags, 1,
+		    snapshot->tags_len, stdout);
+		return;
+	}
+	tags_html(&html);
+	fwrite(blob_buffer(&html), 1, blob_size(&html), stdout);
+	blob_reset(&html);
+}
+
+/* strings of the snapshot are appended after the header */
+static uint32_t
+snapshot_string(Blob *out, const char *s, int len)
+{
+	uint32_t off = blob_size(out);
+
+	blob_append(out, s, len);
+	blob_append(out, "", 1);
+	return (off);
+}
+
+/* --snapshot, write the config and the tags html for the requests */
+static int
+snapshot_write(const char *fn, const char *conffile)
+{
+	struct snapshot head;
+	Blob out = empty_blob, html = empty_blob;
+	char tmp[256];
+	struct stat conf;
+	const char *value;
+	FILE *fp;
+	int i;
+
+	if (stat(conffile, &conf) == -1) {
+		fprintf(stderr, "%s: %s: %s\n", __func__, conffile,
+		    strerror(errno));
+		return (-1);
+	}
+	memset(&head, 0, sizeof(head));
+	memcpy(head.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+	head.version = SNAPSHOT_VERSION;
+	head.conf_size = conf.st_size;
+	head.conf_mtime = conf.st_mtime;
+	head.conf_ino = conf.st_ino;
+	head.feeds = config_feeds;
+	blob_append(&out, (const char *)&head, sizeof(head));
+	for (i = 0; snapshot_keys[i]; i++) {
+		if ((value = config_get(snapshot_keys[i])) != NULL)
+			head.value[i] = snapshot_string(&out, value, -1);
+	}
+	tags_html(&html);
+	head.tags_len = blob_size(&html);
+	head.tags = snapshot_string(&out, blob_buffer(&html),
+	    blob_size(&html));
+	blob_reset(&html);
+	head.size = blob_size(&out);
+	memcpy(blob_buffer(&out), &head, sizeof(head));
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", fn);
+	if ((fp = fopen(tmp, "w")) == NULL) {
+		fprintf(stderr, "%s: %s: %s\n", __func__, tmp, strerror(errno));
+		blob_reset(&out);
+		return (-1);
+	}
+	fwrite(blob_buffer(&out), 1, blob_size(&out), fp);
+	if (fclose(fp) != 0 || rename(tmp, fn) != 0) {
+		fprintf(stderr, "%s: %s: %s\n", __func__, fn, strerror(errno));
+		unlink(tmp);
+		blob_reset(&out);
+		return (-1);
+	}
+	printf("%s: %u bytes\n", fn, head.size);
+	blob_reset(&out);
+	return (0);
+}
+
+/* feed supplied text, escaped for the html page */
+static void
+render_escape(const char *s)
+{
+	for (; s && *s; s++) {
+		switch (*s) {
+		case '<':
+			fputs("&lt;", stdout);
+			break;
+		case '>':
+			fputs("&gt;", stdout);
+			break;
+		case '&':
+			fputs("&amp;", stdout);
+			break;
+		case '"':
+			fputs("&quot;", stdout);
+			break;
+		case '\'':
+			fputs("&#39;", stdout);
+			break;
+		default:
+			putchar(*s);
+		}
+	}
+}
 
 static void
 render_print(const char *macro, void *arg)
@@ -246,13 +860,13 @@ render_print(const char *macro, void *arg)
 	struct item *current = (struct item *)arg;
 
 	if (strcmp(macro, "BASEURL") == 0) {
-		printf("%s", queue_get(&config, "url"));
+		printf("%s", config_get("url"));
 	} else if (strcmp(macro, "NAME") == 0) {
-		printf("%s", queue_get(&config, "name"));
+		printf("%s", config_get("name"));
 	} else if (strcmp(macro, "OWNER") == 0) {
-		printf("%s", queue_get(&config, "owner"));
+		printf("%s", config_get("owner"));
 	} else if (strcmp(macro, "CTYPE") == 0) {
-		printf("%s", queue_get(&config, "ct_html"));
+		printf("%s", config_get("ct_html"));
 	} else if (current == NULL) {
 		return;
 	} else if (strcmp(macro, "TITLE") == 0) {
@@ -260,16 +874,24 @@ render_print(const char *macro, void *arg)
 	} else if (strcmp(macro, "PUBDATE") == 0) {
 		(current->date) && printf("%s", ctime(&current->date));
 	} else if (strcmp(macro, "DESCRIPTION") == 0) {
-		(current->desc) && printf("%s", current->desc);
+		if (current->compressed)
+			zdesc_write(stdout, current->desc, current->desclen);
+		else
+			(current->desc) && printf("%s", current->desc);
 	} else if (strcmp(macro, "URL") == 0) {
 		(current->url) && printf("%s", current->url);
 	} else if (strcmp(macro, "FOLLOW") == 0) {
 		(current->chanid) && printf("%ld", current->chanid);
+	} else if (strcmp(macro, "SITE") == 0) {
+		render_escape(current->site);
 	} else if (strcmp(macro, "CHANNEL") == 0) {
-		if (current->url) {
-			char domain[64];
+		if (current->channel && *current->channel) {
+			render_escape(current->channel);
+		} else if (current->url) {
+			/* not crawled since the channel title is stored */
+			char domain[64] = "";
 			sscanf(current->url, "%*[^//]//%63[^/]", domain);
-			printf("%s", domain);
+			render_escape(domain);
 		}
 	}
 }
@@ -280,28 +902,30 @@ config_render(void)
 	char fn[256];
 
 	render_init(&render);
-	snprintf(fn, sizeof(fn), "%s/main.html", queue_get(&config, "htmldir"));
+	snprintf(fn, sizeof(fn), "%s/main.html", config_get("htmldir"));
 	render_add(&render, "MAIN", fn, (struct item *)render_main);
-	snprintf(fn, sizeof(fn), "%s/%s/header.html", queue_get(&config, "htmldir"),
-	    queue_get(&config, "webtheme"));
+	snprintf(fn, sizeof(fn), "%s/%s/header.html", config_get("htmldir"),
+	    config_get("webtheme"));
 	render_add(&render, "HEADER", fn, (struct item *)render_main);
-	snprintf(fn, sizeof(fn), "%s/%s/footer.html", queue_get(&config, "htmldir"),
-	    queue_get(&config, "webtheme"));
+	snprintf(fn, sizeof(fn), "%s/%s/footer.html", config_get("htmldir"),
+	    config_get("webtheme"));
 	render_add(&render, "FOOTER", fn, (struct item *)render_main);
 	render_add(&render, "FEEDS", NULL, (struct entry *)render_items_list);
-	snprintf(fn, sizeof(fn), "%s/%s/feed.html", queue_get(&config, "htmldir"),
-	    queue_get(&config, "webtheme"));
+	snprintf(fn, sizeof(fn), "%s/%s/feed.html", config_get("htmldir"),
+	    config_get("webtheme"));
 	render_add(&render, "ITEMHTML", fn, (struct entry *)render_main);
 	render_add(&render, "BASEURL", NULL, (struct item *)render_print);
 	render_add(&render, "NAME", NULL, (struct item *)render_print);
 	render_add(&render, "OWNER", NULL, (struct item *)render_print);
 	render_add(&render, "CTYPE", NULL, (struct item *)render_print);
 	render_add(&render, "TAGS", NULL, (struct item *)render_tags);
+	render_add(&render, "SEARCH", NULL, (struct item *)render_search);
 	render_add(&render, "PUBDATE", NULL, (struct item *)render_print);
 	render_add(&render, "TITLE", NULL, (struct item *)render_print);
 	render_add(&render, "DESCRIPTION", NULL, (struct item *)render_print);
 	render_add(&render, "URL", NULL, (struct item *)render_print);
 	render_add(&render, "CHANNEL", NULL, (struct item *)render_print);
+	render_add(&render, "SITE", NULL, (struct item *)render_print);
 	render_add(&render, "FOLLOW", NULL, (struct item *)render_print);
 	render_add(&render, "PREV", NULL, (struct item*)render_prev);
 	render_add(&render, "NEXT", NULL, (struct item*)render_next);
@@ -310,15 +934,21 @@ config_render(void)
 int
 main(int argc, char *argv[])
 {
-	char *conffile, *query_string;
+	char *conffile, *query_string, *gzpage = NULL;
 	const char *confcheck;
-	int i, valgrind = 0;
+	size_t gzlen = 0;
+	FILE *page = NULL, *mem;
+	int i, valgrind = 0, snap = 0;
+	uint64_t phase;
 
+	trace_start = phase = trace_now();
 	umask(007);
 
 	for (i = 1; i < argc; i++) {
 		if (strcmp(argv[i], "--valgrind") == 0) {
 			valgrind = 1;
+		} else if (strcmp(argv[i], "--snapshot") == 0) {
+			snap = 1;
 		}
 	}
 
@@ -333,6 +963,12 @@ main(int argc, char *argv[])
 			goto purge;
 		}
 	}
+	/* a fresh snapshot replaces the config file and the tags query */
+	if (!snap)
+		snapshot_open(valgrind ? SNAPSHOT_TEST : SNAPSHOT_FILE,
+		    conffile);
+	if (snapshot)
+		goto query;
 	if (queue_file(conffile, &config) == -1) {
 		render_error("error: cannot open config file: %s", conffile);
 		goto purge;
@@ -351,36 +987,94 @@ main(int argc, char *argv[])
 		render_error("error: missing config: %s", confcheck);
 		goto purge;
 	}
-	if (strtol(queue_get(&config, "feeds"), (char **)NULL, 10) <= 0) {
+	if ((config_feeds = strtol(config_get("feeds"), (char **)NULL,
+	    10)) <= 0) {
 		render_error("error: number of feeds cannot be 0 or lower");
 		goto purge;
 	}
+	if (snap) {
+		if (sqlite3_open(config_get("dbpath"), &g.db) != SQLITE_OK) {
+			fprintf(stderr, "cannot load database: %s\n",
+			    config_get("dbpath"));
+			goto purge;
+		}
+		snapshot_write(valgrind ? SNAPSHOT_TEST : SNAPSHOT_FILE,
+		    conffile);
+		sqlite3_close(g.db);
+		goto purge;
+	}
+query:
+	phase = trace_phase("config", phase);
 
 	if (((query_string = getenv("QUERY_STRING")) != NULL) && strlen(query_string)) {
-		if (query_string_validate(query_string) == -1) {
+		snprintf(trace_query, sizeof(trace_query), "%s", query_string);
+		if (strncmp(query_string, "q=", 2) == 0) {
+			if (search_parse(query_string) == -1) {
+				goto purge;
+			}
+		} else if (query_string_validate(query_string) == -1) {
 			goto purge;
 		}
 	}
 
-	if (query_parse(query_string) == -1) {
+	if ((search_match[0] == 0) && (query_parse(query_string) == -1)) {
                	printf("Status: 400\r\n\r\nYou are trying to send wrong query!\n");
 	       	fflush(stdout);
 		goto purge;
 	}
 
-	if (sqlite3_open(queue_get(&config, "dbpath"), &g.db) != SQLITE_OK) {
-		render_error("cannot load database: %s", queue_get(&config, "dbpath"));
+	phase = trace_now();
+	if (config_get("cache") && cache_check(conffile,
+	    valgrind ? SNAPSHOT_TEST : SNAPSHOT_FILE)) {
+		printf("Status: 304");
+		cache_headers();
+		gzip_vary();
+		printf("\r\n\r\n");
+		fflush(stdout);
+		trace_phase("cached", phase);
+		trace_log();
 		goto purge;
 	}
+	if (sqlite3_open(config_get("dbpath"), &g.db) != SQLITE_OK) {
+		render_error("cannot load database: %s", config_get("dbpath"));
+		goto purge;
+	}
+	phase = trace_phase("open", phase);
 
-	printf("%s\r\n\r\n", queue_get(&config, "ct_html"));
+	/* render into memory, compress on the way out */
+	if (gzip_accepted() &&
+	    (mem = open_memstream(&gzpage, &gzlen)) != NULL) {
+		printf("%s", config_get("ct_html"));
+		cache_headers();
+		printf("\r\nContent-Encoding: gzip");
+		gzip_vary();
+		printf("\r\n\r\n");
+		fflush(stdout);
+		page = stdout;
+		stdout = mem;
+	} else {
+		printf("%s", config_get("ct_html"));
+		cache_headers();
+		gzip_vary();
+		printf("\r\n\r\n");
+	}
 	config_render();
 	render_run(&render, "MAIN", NULL);
+	trace_phase("render", phase);
+	if (page) {
+		fclose(stdout);
+		stdout = page;
+		gzip_write(stdout, gzpage, gzlen);
+		free(gzpage);
+	}
 	fflush(stdout);
 
 	render_purge(&render);
 	sqlite3_close(g.db);
+	trace_log();
 purge:
 	queue_purge(&config);
+	if (snapshot)
+		munmap((void *)snapshot, snapshot_size);
 	return (0);
 }
@@ -0,0 +1,350 @@
+/*
+ * Copyright (c) 2026 Nikola Kolev <koue@chaosophia.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Bulk ingest of saved feed files (-f).
+ *
+ * The argument is either a directory, walked recursively, or a glob(3)
+ * pattern. Every file is mapped to a channel in the main thread: the
+ * link has to end with the path of the file below the directory (a tree
+ * mirrored as host/path/file), or with any shorter tail of it down to
+ * the file name. Files which do not match a link are looked up by the
+ * channel title, file name without extension. The files are then mapped
+ * into memory and parsed by a pool of threads in batches, every batch is
+ * stored in one transaction in the order of the file names.
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fts.h>
+#include <glob.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <fslbase.h>
+#include <fsldb.h>
+#include <sqlite3.h>
+
+#include "rss.h"
+
+#define INGEST_BATCH	64
+
+struct ingest_file {
+	char *path;
+	const char *name;	/* path below the walked directory */
+	int chanid;
+	long tagid;
+	int sniff;
+	size_t size;
+	struct feed *rss;
+};
+
+struct ingest_batch {
+	pthread_mutex_t lock;
+	struct ingest_file *files;
+	int count;
+	int next;
+	int maxitems;
+};
+
+static struct ingest_file *ingest_files = NULL;
+static int ingest_count = 0;
+
+static void
+ingest_add(const char *path, size_t skip)
+{
+	struct ingest_file *file;
+
+	if ((ingest_files = realloc(ingest_files,
+	    (ingest_count + 1) * sizeof(struct ingest_file))) == NULL) {
+		fprintf(stderr, "%s: %s\n", __func__, strerror(errno));
+		exit(1);
+	}
+	file = &ingest_files[ingest_count++];
+	memset(file, 0, sizeof(struct ingest_file));
+	if ((file->path = strdup(path)) == NULL) {
+		fprintf(stderr, "%s: %s\n", __func__, strerror(errno));
+		exit(1);
+	}
+	file->name = file->path + skip;
+	file->chanid = -1;
+	file->sniff = RSS_SNIFF_REJECT;
+}
+
+static int
+ingest_cmp(const FTSENT **a, const FTSENT **b)
+{
+	return (strcmp((*a)->fts_name, (*b)->fts_name));
+}
+
+/* collect regular files of directory or glob pattern */
+static void
+ingest_collect(const char *arg)
+{
+	char *paths[] = { (char *)arg, NULL };
+	const char *base;
+	struct stat st;
+	FTSENT *ent;
+	glob_t g;
+	size_t i, skip;
+	FTS *fts;
+
+	if (stat(arg, &st) == 0 && S_ISDIR(st.st_mode)) {
+		if ((fts = fts_open(paths, FTS_PHYSICAL | FTS_NOCHDIR,
+		    ingest_cmp)) == NULL) {
+			fprintf(stderr, "%s: %s: %s\n", __func__, arg,
+			    strerror(errno));
+			return;
+		}
+		while ((ent = fts_read(fts)) != NULL) {
+			if (ent->fts_info != FTS_F)
+				continue;
+			for (skip = strlen(arg); ent->fts_path[skip] == '/';
+			    skip++)
+				;
+			ingest_add(ent->fts_path, skip);
+		}
+		fts_close(fts);
+		return;
+	}
+	if (glob(arg, 0, NULL, &g) != 0) {
+		fprintf(stderr, "%s: %s: no match\n", __func__, arg);
+		return;
+	}
+	for (i = 0; i < g.gl_pathc; i++) {
+		if (stat(g.gl_pathv[i], &st) == -1 || !S_ISREG(st.st_mode))
+			continue;
+		base = strrchr(g.gl_pathv[i], '/');
+		ingest_add(g.gl_pathv[i], base ? base - g.gl_pathv[i] + 1 : 0);
+	}
+	globfree(&g);
+}
+
+/* number of channels found by q, the first one is taken */
+static int
+ingest_match(Stmt *q, struct ingest_file *file)
+{
+	int matches = 0;
+
+	while (db_step(q) == SQLITE_ROW) {
+		if (matches++ == 0) {
+			file->chanid = db_column_int(q, 0);
+			file->tagid = db_column_int64(q, 1);
+		}
+	}
+	db_finalize(q);
+	return (matches);
+}
+
+/* find the channel of file, -1 if none or more than one */
+static int
+ingest_channel(struct ingest_file *file)
+{
+	const char *p = file->name, *ext;
+	char stem[256];
+	int matches;
+	Stmt q;
+
+	for (;;) {
+		db_prepare(&q, "SELECT id, tagid FROM channels "
+				"WHERE substr(link, -%d) = '/' || %Q",
+				(int)strlen(p) + 1, p);
+		if ((matches = ingest_match(&q, file)) != 0)
+			break;
+		if ((p = strchr(p, '/')) == NULL)
+			break;
+		p++;
+	}
+	if (matches == 0) {
+		p = strrchr(file->name, '/') ? strrchr(file->name, '/') + 1 :
+		    file->name;
+		snprintf(stem, sizeof(stem), "%s", p);
+		if ((ext = strrchr(stem, '.')) != NULL && ext != stem)
+			stem[ext - stem] = 0;
+		db_prepare(&q, "SELECT id, tagid FROM channels "
+				"WHERE title = %Q", stem);
+		matches = ingest_match(&q, file);
+	}
+	if (matches == 1)
+		return (0);
+	if (matches == 0)
+		printf("%s: no channel found.\n", file->path);
+	else
+		printf("%s: %d channels match.\n", file->path, matches);
+	file->chanid = -1;
+	return (-1);
+}
+
+static void
+ingest_parse(struct ingest_file *file, int maxitems)
+{
+	struct stat st;
+	void *map;
+	int fd;
+
+	if ((fd = open(file->path, O_RDONLY)) == -1) {
+		fprintf(stderr, "%s: %s: %s\n", __func__, file->path,
+		    strerror(errno));
+		return;
+	}
+	if (fstat(fd, &st) == -1 || st.st_size == 0) {
+		close(fd);
+		return;
+	}
+	if ((map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) ==
+	    MAP_FAILED) {
+		fprintf(stderr, "%s: %s: %s\n", __func__, file->path,
+		    strerror(errno));
+		close(fd);
+		return;
+	}
+	close(fd);
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+	file->size = st.st_size;
+	/* the document is a copy, the mapping is not needed after parse */
+	if ((file->sniff = rss_sniff(map, st.st_size)) != RSS_SNIFF_REJECT)
+		file->rss = rss_parse_buffer(map, st.st_size, maxitems, 0);
+	munmap(map, st.st_size);
+}
+
+static void *
+ingest_thread(void *arg)
+{
+	struct ingest_batch *batch = arg;
+	int i;
+
+	for (;;) {
+		pthread_mutex_lock(&batch->lock);
+		i = batch->next++;
+		pthread_mutex_unlock(&batch->lock);
+		if (i >= batch->count)
+			break;
+		ingest_parse(&batch->files[i], batch->maxitems);
+	}
+	return (NULL);
+}
+
+/* parse the batch with threads, then store it in file order */
+static int
+ingest_batch(struct ingest_batch *batch, int threads)
+{
+	struct ingest_file *file;
+	pthread_t *tid;
+	int i, started, count = 0, added;
+
+	if ((tid = calloc(threads, sizeof(pthread_t))) == NULL) {
+		fprintf(stderr, "%s: %s\n", __func__, strerror(errno));
+		exit(1);
+	}
+	batch->next = 0;
+	for (started = 0; started < threads && started < batch->count;
+	    started++) {
+		if (pthread_create(&tid[started], NULL, ingest_thread,
+		    batch) != 0)
+			break;
+	}
+	/* no thread, parse here */
+	if (started == 0)
+		ingest_thread(batch);
+	for (i = 0; i < started; i++)
+		pthread_join(tid[i], NULL);
+	free(tid);
+
+	db_multi_exec("BEGIN");
+	for (i = 0; i < batch->count; i++) {
+		file = &batch->files[i];
+		metrics_sniff(file->sniff);
+		if (file->sniff == RSS_SNIFF_REJECT) {
+			printf("%s: not a feed.\n", file->path);
+		} else if (file->rss == NULL) {
+			printf("%s: cannot be parsed.\n", file->path);
+			metrics_add(M_PARSE_ERRORS, 1);
+		} else if ((added = store_feed(file->chanid, file->rss)) > 0) {
+			summary_mark(file->tagid);
+			count += added;
+		}
+	}
+	db_multi_exec("COMMIT");
+	return (count);
+}
+
+/* ingest files of directory or glob pattern, returns new items */
+int
+ingest_run(const char *arg, int threads, int maxitems)
+{
+	struct ingest_batch batch;
+	uint64_t start = metrics_now(), bytes = 0, elapsed;
+	int i, j, mapped = 0, count = 0;
+
+	ingest_collect(arg);
+	/* drop the files without channel, the rest keeps its order */
+	for (i = 0; i < ingest_count; i++) {
+		if (ingest_channel(&ingest_files[i]) == -1)
+			continue;
+		if (mapped != i) {
+			free(ingest_files[mapped].path);
+			ingest_files[mapped] = ingest_files[i];
+			ingest_files[i].path = NULL;
+		}
+		mapped++;
+	}
+	dmsg(0, "%s: %d files, %d with channel", __func__, ingest_count,
+	    mapped);
+
+	xmlInitParser();
+	pthread_mutex_init(&batch.lock, NULL);
+	batch.maxitems = maxitems;
+	for (i = 0; i < mapped; i += INGEST_BATCH) {
+		batch.files = &ingest_files[i];
+		batch.count = mapped - i < INGEST_BATCH ? mapped - i :
+		    INGEST_BATCH;
+		count += ingest_batch(&batch, threads);
+		for (j = 0; j < batch.count; j++)
+			bytes += batch.files[j].size;
+	}
+	pthread_mutex_destroy(&batch.lock);
+	for (i = 0; i < ingest_count; i++)
+		free(ingest_files[i].path);
+	free(ingest_files);
+
+	elapsed = metrics_now() - start;
+	printf("%d files (%d skipped), %llu bytes ingested in %.3f s "
+	    "(%.2f MB/s), %d new items.\n", mapped, ingest_count - mapped,
+	    (unsigned long long)bytes, elapsed / 1e6,
+	    elapsed ? bytes / (elapsed / 1e6) / 1e6 : 0, count);
+	ingest_files = NULL;
+	ingest_count = 0;
+	return (count);
+}
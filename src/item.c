@@ -46,8 +46,12 @@ item_create(struct pool *pool)
 	item->title = NULL;
 	item->url = NULL;
 	item->desc = NULL;
+	item->desclen = 0;
+	item->compressed = 0;
 	item->date = 0;
 	item->chanid = 0;
+	item->channel = NULL;
+	item->site = NULL;
 
 	return (item);
 }
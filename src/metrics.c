@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2026 Nikola Kolev <koue@chaosophia.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/*
+ * Crawler metrics.
+ *
+ * Counters and latency histograms of one run, written at the end of the
+ * run (rssroll -m file) in Prometheus textfile format, or in JSON when
+ * the file name ends with ".json". The file is replaced atomically, the
+ * node_exporter textfile collector never sees a partial file.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rss.h"
+
+static const char *counter_names[METRICS_COUNTERS] = {
+	"channels_total",
+	"channels_failed_total",
+	"channels_truncated_total",
+	"channels_backoff_total",
+	"hosts_total",
+	"hosts_unresolved_total",
+	"body_bytes_total",
+	"body_inflated_bytes_total",
+	"sniff_rss_total",
+	"sniff_rdf_total",
+	"sniff_atom_total",
+	"sniff_unknown_total",
+	"sniff_rejected_total",
+	"parse_errors_total",
+	"items_parsed_total",
+	"items_new_total",
+	"items_duplicate_total",
+	"items_near_duplicate_total",
+};
+
+static const char *timer_names[METRICS_TIMERS] = {
+	"resolve_seconds",
+	"fetch_connect_seconds",
+	"fetch_transfer_seconds",
+	"parse_seconds",
+	"sql_check_link_seconds",
+	"sql_simhash_seconds",
+	"sql_add_feed_seconds",
+	"run_seconds",
+};
+
+/* upper bounds of the histogram buckets in seconds, +Inf is implicit */
+static const double buckets[] = {
+	0.0001, 0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1, 5, 10, 30
+};
+#define	BUCKETS	(sizeof(buckets) / sizeof(buckets[0]))
+
+struct histogram {
+	uint64_t count;
+	double sum;
+	uint64_t bucket[BUCKETS];
+};
+
+static uint64_t		counters[METRICS_COUNTERS];
+static struct histogram	timers[METRICS_TIMERS];
+
+/* body_read() counts from the threads of the OPML import too */
+void
+metrics_add(int counter, uint64_t n)
+{
+	__atomic_add_fetch(&counters[counter], n, __ATOMIC_RELAXED);
+}
+
+/* count the result of rss_sniff() */
+void
+metrics_sniff(int sniff)
+{
+	if (sniff == RSS_SNIFF_REJECT)
+		counters[M_SNIFF_REJECTED]++;
+	else if (sniff == RSS_SNIFF_UNKNOWN)
+		counters[M_SNIFF_UNKNOWN]++;
+	else if (sniff >= ATOM_V0_1)
+		counters[M_SNIFF_ATOM]++;
+	else if (sniff == RSS_V1_0)
+		counters[M_SNIFF_RDF]++;
+	else
+		counters[M_SNIFF_RSS]++;
+}
+
+/* monotonic time in microseconds */
+uint64_t
+metrics_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
+/* observe time elapsed since start */
+void
+metrics_time(int timer, uint64_t start)
+{
+	struct histogram *h = &timers[timer];
+	double elapsed = (metrics_now() - start) / 1e6;
+	size_t i;
+
+	h->count++;
+	h->sum += elapsed;
+	for (i = 0; i < BUCKETS; i++) {
+		if (elapsed <= buckets[i])
+			h->bucket[i]++;
+	}
+}
+
+static void
+metrics_prometheus(FILE *out)
+{
+	size_t i, j;
+
+	for (i = 0; i < METRICS_COUNTERS; i++) {
+		fprintf(out, "# TYPE rssroll_%s counter\n", counter_names[i]);
+		fprintf(out, "rssroll_%s %llu\n", counter_names[i],
+		    (unsigned long long)counters[i]);
+	}
+	for (i = 0; i < METRICS_TIMERS; i++) {
+		fprintf(out, "# TYPE rssroll_%s histogram\n", timer_names[i]);
+		for (j = 0; j < BUCKETS; j++) {
+			fprintf(out, "rssroll_%s_bucket{le=\"%g\"} %llu\n",
+			    timer_names[i], buckets[j],
+			    (unsigned long long)timers[i].bucket[j]);
+		}
+		fprintf(out, "rssroll_%s_bucket{le=\"+Inf\"} %llu\n",
+		    timer_names[i], (unsigned long long)timers[i].count);
+		fprintf(out, "rssroll_%s_sum %.6f\n", timer_names[i],
+		    timers[i].sum);
+		fprintf(out, "rssroll_%s_count %llu\n", timer_names[i],
+		    (unsigned long long)timers[i].count);
+	}
+	fprintf(out, "# TYPE rssroll_last_run_timestamp_seconds gauge\n");
+	fprintf(out, "rssroll_last_run_timestamp_seconds %ld\n",
+	    (long)time(NULL));
+}
+
+static void
+metrics_json(FILE *out)
+{
+	size_t i, j;
+
+	fprintf(out, "{\n  \"timestamp\": %ld,\n  \"counters\": {",
+	    (long)time(NULL));
+	for (i = 0; i < METRICS_COUNTERS; i++) {
+		fprintf(out, "%s\n    \"%s\": %llu", i ? "," : "",
+		    counter_names[i], (unsigned long long)counters[i]);
+	}
+	fprintf(out, "\n  },\n  \"timers\": {");
+	for (i = 0; i < METRICS_TIMERS; i++) {
+		fprintf(out, "%s\n    \"%s\": { \"count\": %llu, "
+		    "\"sum\": %.6f, \"buckets\": {", i ? "," : "",
+		    timer_names[i], (unsigned long long)timers[i].count,
+		    timers[i].sum);
+		for (j = 0; j < BUCKETS; j++) {
+			fprintf(out, "%s\"%g\": %llu", j ? ", " : " ",
+			    buckets[j],
+			    (unsigned long long)timers[i].bucket[j]);
+		}
+		fprintf(out, " } }");
+	}
+	fprintf(out, "\n  }\n}\n");
+}
+
+int
+metrics_write(const char *path)
+{
+	char tmp[256];
+	size_t len = strlen(path);
+	FILE *out;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	if ((out = fopen(tmp, "w")) == NULL) {
+		fprintf(stderr, "%s: %s: %s\n", __func__, tmp, strerror(errno));
+		return (-1);
+	}
+	if (len > 5 && strcmp(path + len - 5, ".json") == 0)
+		metrics_json(out);
+	else
+		metrics_prometheus(out);
+	if (fclose(out) != 0 || rename(tmp, path) != 0) {
+		fprintf(stderr, "%s: %s: %s\n", __func__, path, strerror(errno));
+		unlink(tmp);
+		return (-1);
+	}
+	return (0);
+}
@@ -0,0 +1,444 @@
+/*
+ * Copyright (c) 2026 Nikola Kolev <koue@chaosophia.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * OPML import (-I) and export (-E).
+ *
+ * Every outline with xmlUrl is a subscription, it goes into the tag named
+ * by the closest enclosing outline without xmlUrl. Top level outlines go
+ * into the tag named by the title of the document. The links which are
+ * not in the channels yet are validated by a pool of threads: the feed is
+ * fetched, sniffed and parsed. All valid channels are then inserted in
+ * one transaction together with their items, the Last-Modified of the
+ * answer becomes the first conditional GET of the next crawl. Nothing is
+ * inserted for the links which fail.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <fetch.h>
+#include <fslbase.h>
+#include <fsldb.h>
+#include <sqlite3.h>
+
+#include "rss.h"
+#include "xml.h"
+
+#define	OPML_TIMEOUT	60	/* seconds per fetch */
+
+struct opml_outline {
+	char *url;
+	char *title;
+	char *site;
+	const char *tag;
+	const char *error;
+	int sniffed;
+	int sniff;
+	time_t modified;
+	struct feed *rss;
+};
+
+struct opml_import {
+	pthread_mutex_t lock;
+	struct pool *pool;
+	struct opml_outline *outlines;
+	int count;
+	int known;
+	int next;
+	size_t body_max;
+	int maxitems;
+};
+
+static char *
+opml_attr(struct pool *pool, xmlNode *node, const char *name)
+{
+	char *value;
+
+	if ((value = xml_get_value(pool, node, name)) != NULL && *value == 0)
+		return (NULL);
+	return (value);
+}
+
+static void
+opml_add(struct opml_import *imp, xmlNode *node, char *url, const char *tag)
+{
+	struct opml_outline *outline;
+	int i;
+
+	if (db_exists("SELECT 1 FROM channels WHERE link = %Q", url)) {
+		dmsg(0, "%s: known %s", __func__, url);
+		imp->known++;
+		return;
+	}
+	for (i = 0; i < imp->count; i++) {
+		if (strcmp(imp->outlines[i].url, url) == 0) {
+			imp->known++;
+			return;
+		}
+	}
+	if ((imp->outlines = realloc(imp->outlines,
+	    (imp->count + 1) * sizeof(struct opml_outline))) == NULL) {
+		fprintf(stderr, "%s: %s\n", __func__, strerror(errno));
+		exit(1);
+	}
+	outline = &imp->outlines[imp->count++];
+	memset(outline, 0, sizeof(struct opml_outline));
+	outline->url = url;
+	if ((outline->title = opml_attr(imp->pool, node, "title")) == NULL)
+		outline->title = opml_attr(imp->pool, node, "text");
+	outline->site = opml_attr(imp->pool, node, "htmlUrl");
+	outline->tag = tag;
+}
+
+/* collect the subscriptions below node */
+static void
+opml_walk(struct opml_import *imp, xmlNode *node, const char *tag)
+{
+	char *url, *folder;
+
+	for (; node; node = node->next) {
+		if (node->type != XML_ELEMENT_NODE ||
+		    !xml_isnode(node, "outline", 0))
+			continue;
+		if ((url = opml_attr(imp->pool, node, "xmlUrl")) != NULL) {
+			opml_add(imp, node, url, tag);
+			continue;
+		}
+		if ((folder = opml_attr(imp->pool, node, "title")) == NULL &&
+		    (folder = opml_attr(imp->pool, node, "text")) == NULL)
+			folder = (char *)tag;
+		opml_walk(imp, node->children, folder);
+	}
+}
+
+static int
+opml_read(struct opml_import *imp, const char *path)
+{
+	xmlNode *root, *node, *child, *body = NULL;
+	const char *tag = "opml";
+	char *title;
+	xmlDoc *doc;
+
+	/* no network access and no entity expansion for the outlines */
+	if ((doc = xmlReadFile(path, NULL, XML_PARSE_NONET)) == NULL) {
+		fprintf(stderr, "%s: %s: cannot parse\n", __func__, path);
+		return (-1);
+	}
+	if ((root = xmlDocGetRootElement(doc)) == NULL ||
+	    !xml_isnode(root, "opml", 0)) {
+		fprintf(stderr, "%s: %s: not OPML\n", __func__, path);
+		xmlFreeDoc(doc);
+		return (-1);
+	}
+	for (node = root->children; node; node = node->next) {
+		if (node->type != XML_ELEMENT_NODE)
+			continue;
+		if (xml_isnode(node, "body", 0)) {
+			body = node;
+		} else if (xml_isnode(node, "head", 0)) {
+			for (child = node->children; child;
+			    child = child->next) {
+				if (child->type == XML_ELEMENT_NODE &&
+				    xml_isnode(child, "title", 0) &&
+				    (title = xml_get_content(imp->pool,
+				    child)) != NULL && *title)
+					tag = title;
+			}
+		}
+	}
+	if (body)
+		opml_walk(imp, body->children, tag);
+	xmlFreeDoc(doc);
+	return (0);
+}
+
+/* fetch and parse outline, error is set when it is not a feed */
+static void
+opml_validate(struct opml_outline *outline, size_t body_max, int maxitems)
+{
+	Blob body = empty_blob;
+	struct url_stat us;
+	struct url *url;
+	FILE *fp;
+	int rc;
+
+	if ((url = fetchParseURL(outline->url)) == NULL) {
+		outline->error = "invalid URL";
+		return;
+	}
+	memset(&us, 0, sizeof(us));
+	if ((fp = fetchXGet(url, &us, "")) == NULL) {
+		outline->error = "cannot fetch";
+		goto fail;
+	}
+	rc = body_read(&body, fp, body_max);
+	fclose(fp);
+	if (rc == -1) {
+		outline->error = "broken compressed body";
+		goto reset;
+	}
+	if (blob_size(&body) < 1) {
+		outline->error = "empty body";
+		goto reset;
+	}
+	outline->modified = us.mtime ? us.mtime : time(NULL);
+	outline->sniff = rss_sniff(blob_buffer(&body), blob_size(&body));
+	outline->sniffed = 1;
+	if (outline->sniff == RSS_SNIFF_REJECT) {
+		outline->error = "not a feed";
+		goto reset;
+	}
+	if ((outline->rss = rss_parse_buffer(blob_buffer(&body),
+	    blob_size(&body), maxitems, rc == 1)) == NULL)
+		outline->error = "cannot be parsed";
+reset:
+	blob_reset(&body);
+fail:
+	fetchFreeURL(url);
+}
+
+static void *
+opml_thread(void *arg)
+{
+	struct opml_import *imp = arg;
+	int i;
+
+	for (;;) {
+		pthread_mutex_lock(&imp->lock);
+		i = imp->next++;
+		pthread_mutex_unlock(&imp->lock);
+		if (i >= imp->count)
+			break;
+		opml_validate(&imp->outlines[i], imp->body_max, imp->maxitems);
+	}
+	return (NULL);
+}
+
+/* insert the valid channel with its items, returns the new items */
+static int
+opml_store(struct opml_outline *outline)
+{
+	struct feed *rss = outline->rss;
+	long tagid;
+	int chanid, count;
+
+	db_multi_exec("INSERT OR IGNORE INTO tags (title) VALUES (%Q)",
+	    outline->tag);
+	tagid = db_int(0, "SELECT id FROM tags WHERE title = %Q",
+	    outline->tag);
+	db_multi_exec("INSERT INTO channels (tagid, modified, link, title, "
+			"site, truncated) VALUES (%ld, 0, %Q, %Q, %Q, 0)",
+			tagid, outline->url, outline->title, outline->site);
+	chanid = (int)sqlite3_last_insert_rowid(g.db);
+	websub_discover(chanid, rss->hub, rss->self);
+	if ((count = store_feed(chanid, rss)) > 0)
+		summary_mark(tagid);
+	/* the next crawl asks only for newer content */
+	db_multi_exec("UPDATE channels SET modified = %ld WHERE id = %d",
+	    (long)outline->modified, chanid);
+	printf("Channel has been added %s.\n", outline->url);
+	return (count);
+}
+
+/* import subscriptions of OPML file, returns the new channels */
+int
+opml_import(const char *path, int threads, size_t body_max, int maxitems)
+{
+	struct opml_import imp;
+	struct opml_outline *outline;
+	pthread_t *tid;
+	uint64_t start = metrics_now(), elapsed;
+	int i, started, added = 0, items = 0;
+
+	memset(&imp, 0, sizeof(imp));
+	imp.pool = pool_create(1024);
+	imp.body_max = body_max;
+	imp.maxitems = maxitems;
+	xmlInitParser();
+	if (opml_read(&imp, path) == -1)
+		goto done;
+	dmsg(0, "%s: %d new, %d known", __func__, imp.count, imp.known);
+
+	/* fetchXGet() cannot hang a thread forever */
+	fetchTimeout = OPML_TIMEOUT;
+	if ((tid = calloc(threads, sizeof(pthread_t))) == NULL) {
+		fprintf(stderr, "%s: %s\n", __func__, strerror(errno));
+		exit(1);
+	}
+	pthread_mutex_init(&imp.lock, NULL);
+	for (started = 0; started < threads && started < imp.count;
+	    started++) {
+		if (pthread_create(&tid[started], NULL, opml_thread,
+		    &imp) != 0)
+			break;
+	}
+	/* no thread, validate here */
+	if (started == 0)
+		opml_thread(&imp);
+	for (i = 0; i < started; i++)
+		pthread_join(tid[i], NULL);
+	free(tid);
+	pthread_mutex_destroy(&imp.lock);
+
+	db_multi_exec("BEGIN");
+	for (i = 0; i < imp.count; i++) {
+		outline = &imp.outlines[i];
+		metrics_add(M_CHANNELS, 1);
+		if (outline->sniffed)
+			metrics_sniff(outline->sniff);
+		if (outline->rss == NULL) {
+			printf("%s: %s.\n", outline->url, outline->error);
+			metrics_add(M_CHANNELS_FAILED, 1);
+			if (outline->sniffed &&
+			    outline->sniff != RSS_SNIFF_REJECT)
+				metrics_add(M_PARSE_ERRORS, 1);
+			continue;
+		}
+		items += opml_store(outline);
+		added++;
+	}
+	db_multi_exec("COMMIT");
+
+	elapsed = metrics_now() - start;
+	printf("%d outlines (%d known), %d channels added, %d invalid, "
+	    "%d new items in %.3f s.\n", imp.count + imp.known, imp.known,
+	    added, imp.count - added, items, elapsed / 1e6);
+done:
+	free(imp.outlines);
+	pool_free(imp.pool);
+	return (added);
+}
+
+static void
+opml_escape(FILE *out, const char *s)
+{
+	for (; s && *s; s++) {
+		switch (*s) {
+		case '<':
+			fputs("&lt;", out);
+			break;
+		case '>':
+			fputs("&gt;", out);
+			break;
+		case '&':
+			fputs("&amp;", out);
+			break;
+		case '"':
+			fputs("&quot;", out);
+			break;
+		default:
+			fputc(*s, out);
+		}
+	}
+}
+
+static void
+opml_outline(FILE *out, Stmt *q, const char *indent)
+{
+	const char *title;
+
+	if ((title = db_column_text(q, 1)) == NULL || *title == 0)
+		title = db_column_text(q, 0);
+	fprintf(out, "%s<outline type=\"rss\" text=\"", indent);
+	opml_escape(out, title);
+	fputs("\" title=\"", out);
+	opml_escape(out, title);
+	fputs("\" xmlUrl=\"", out);
+	opml_escape(out, db_column_text(q, 0));
+	if (db_column_text(q, 2) && *db_column_text(q, 2)) {
+		fputs("\" htmlUrl=\"", out);
+		opml_escape(out, db_column_text(q, 2));
+	}
+	if (db_column_text(q, 3) && *db_column_text(q, 3)) {
+		fputs("\" language=\"", out);
+		opml_escape(out, db_column_text(q, 3));
+	}
+	fputs("\"/>\n", out);
+}
+
+/* write the channels grouped by tags, "-" for stdout */
+int
+opml_export(const char *path)
+{
+	char date[64];
+	time_t now = time(NULL);
+	FILE *out;
+	Stmt t, q;
+
+	if (strcmp(path, "-") == 0) {
+		out = stdout;
+	} else if ((out = fopen(path, "w")) == NULL) {
+		fprintf(stderr, "%s: %s: %s\n", __func__, path, strerror(errno));
+		return (-1);
+	}
+	strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT",
+	    gmtime(&now));
+	fprintf(out, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	    "<opml version=\"2.0\">\n"
+	    "  <head>\n"
+	    "    <title>rssroll</title>\n"
+	    "    <dateCreated>%s</dateCreated>\n"
+	    "  </head>\n"
+	    "  <body>\n", date);
+	db_prepare(&t, "SELECT id, title FROM tags ORDER BY id");
+	while (db_step(&t) == SQLITE_ROW) {
+		fputs("    <outline text=\"", out);
+		opml_escape(out, db_column_text(&t, 1));
+		fputs("\" title=\"", out);
+		opml_escape(out, db_column_text(&t, 1));
+		fputs("\">\n", out);
+		db_prepare(&q, "SELECT link, title, site, language "
+				"FROM channels WHERE tagid = %ld ORDER BY id",
+				(long)db_column_int64(&t, 0));
+		while (db_step(&q) == SQLITE_ROW)
+			opml_outline(out, &q, "      ");
+		db_finalize(&q);
+		fputs("    </outline>\n", out);
+	}
+	db_finalize(&t);
+	/* channels of removed tags */
+	db_prepare(&q, "SELECT link, title, site, language FROM channels "
+			"WHERE tagid IS NULL OR tagid NOT IN "
+			"(SELECT id FROM tags) ORDER BY id");
+	while (db_step(&q) == SQLITE_ROW)
+		opml_outline(out, &q, "    ");
+	db_finalize(&q);
+	fputs("  </body>\n</opml>\n", out);
+	if (out != stdout && fclose(out) != 0) {
+		fprintf(stderr, "%s: %s: %s\n", __func__, path, strerror(errno));
+		return (-1);
+	}
+	return (0);
+}
@@ -0,0 +1,417 @@
+/*
+ * Copyright (c) 2026 Nikola Kolev <koue@chaosophia.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Fetch archive, record (-R) and replay (-P).
+ *
+ * In record mode every fetched body is appended to the archive directory
+ * together with the channel id, link and transfer details. The archive
+ * is a set of append-only segments, rec-<time>-<pid>-<n>.rrs, a new one
+ * is started every RECORD_SEGMENT bytes. Each record is:
+ *
+ *	0	"RR1" and flags (1 truncated, 2 zlib compressed body)
+ *	4	channel id
+ *	8	fetch time
+ *	16	Last-Modified of the response, 0 if none
+ *	24	link length
+ *	28	body length
+ *	32	stored body length
+ *	36	link, stored body
+ *
+ * integers are big-endian. The replay parses the records in batches with
+ * a pool of threads and stores every batch in one transaction, in the
+ * archive order, through the usual store path. It is both offline
+ * re-ingest and a reproducible crawl benchmark.
+ */
+
+#include <sys/stat.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <fslbase.h>
+#include <fsldb.h>
+#include <zlib.h>
+
+#include "rss.h"
+
+#define RECORD_MAGIC	"RR1"
+#define RECORD_HEADER	36
+#define RECORD_SEGMENT	(64 * 1024 * 1024)
+#define RECORD_TRUNCATED	0x01
+#define RECORD_COMPRESSED	0x02
+
+#define REPLAY_BATCH	64
+#define REPLAY_LINK_MAX	(64 * 1024)
+
+static const char *record_dir = NULL;
+static int record_fd = -1;
+static int record_seq = 0;
+static off_t record_offset = 0;
+
+static void
+record_put32(unsigned char *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static uint32_t
+record_get32(const unsigned char *p)
+{
+	return ((uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+	    (uint32_t)p[2] << 8 | p[3]);
+}
+
+static void
+record_put64(unsigned char *p, uint64_t v)
+{
+	record_put32(p, v >> 32);
+	record_put32(p + 4, v);
+}
+
+/* record fetched bodies into dir */
+void
+record_open(const char *dir)
+{
+	record_dir = dir;
+}
+
+static int
+record_segment(void)
+{
+	char fn[256];
+
+	if (record_fd != -1 && record_offset < RECORD_SEGMENT)
+		return (0);
+	if (record_fd != -1)
+		close(record_fd);
+	snprintf(fn, sizeof(fn), "%s/rec-%ld-%ld-%d.rrs", record_dir,
+	    (long)time(NULL), (long)getpid(), record_seq++);
+	if ((record_fd = open(fn, O_WRONLY | O_CREAT | O_APPEND, 0640)) == -1) {
+		fprintf(stderr, "%s: %s: %s\n", __func__, fn, strerror(errno));
+		return (-1);
+	}
+	dmsg(0, "%s: %s", __func__, fn);
+	record_offset = 0;
+	return (0);
+}
+
+/* append body of channel, fetched from link */
+void
+record_body(int chanid, const char *link, time_t modified, int truncated,
+    Blob *body)
+{
+	Blob rec = empty_blob;
+	unsigned char *p;
+	uLongf zlen;
+	size_t linklen = strlen(link);
+	int flags = truncated ? RECORD_TRUNCATED : 0;
+
+	if (record_dir == NULL || record_segment() == -1)
+		return;
+	zlen = compressBound(blob_size(body));
+	blob_resize(&rec, RECORD_HEADER + linklen + zlen);
+	p = (unsigned char *)blob_buffer(&rec);
+	memcpy(p + RECORD_HEADER, link, linklen);
+	if (compress2(p + RECORD_HEADER + linklen, &zlen,
+	    (unsigned char *)blob_buffer(body), blob_size(body), 6) == Z_OK &&
+	    zlen < blob_size(body)) {
+		flags |= RECORD_COMPRESSED;
+	} else {
+		zlen = blob_size(body);
+		memcpy(p + RECORD_HEADER + linklen, blob_buffer(body), zlen);
+	}
+	blob_resize(&rec, RECORD_HEADER + linklen + zlen);
+	p = (unsigned char *)blob_buffer(&rec);
+	memcpy(p, RECORD_MAGIC, 3);
+	p[3] = flags;
+	record_put32(p + 4, chanid);
+	record_put64(p + 8, time(NULL));
+	record_put64(p + 16, modified);
+	record_put32(p + 24, linklen);
+	record_put32(p + 28, blob_size(body));
+	record_put32(p + 32, zlen);
+	/* one write per record, the segment stays readable */
+	if (write(record_fd, p, blob_size(&rec)) != (ssize_t)blob_size(&rec))
+		fprintf(stderr, "%s: %s\n", __func__, strerror(errno));
+	else
+		record_offset += blob_size(&rec);
+	blob_reset(&rec);
+}
+
+void
+record_close(void)
+{
+	if (record_fd != -1)
+		close(record_fd);
+	record_fd = -1;
+}
+
+struct replay_record {
+	int chanid;
+	int flags;
+	int sniff;
+	size_t len;		/* body length */
+	Blob body;		/* stored body */
+	struct feed *rss;
+};
+
+struct replay_batch {
+	pthread_mutex_t lock;
+	struct replay_record *recs;
+	int count;
+	int next;
+	int maxitems;
+};
+
+/* read next record of segment, bodies over max are skipped, 0 at the end */
+static int
+replay_read(FILE *fp, const char *fn, struct replay_record *rec, size_t max)
+{
+	unsigned char h[RECORD_HEADER];
+	uint32_t linklen, stored;
+	size_t n;
+
+	for (;;) {
+		if ((n = fread(h, 1, sizeof(h), fp)) == 0)
+			return (0);
+		if (n != sizeof(h) || memcmp(h, RECORD_MAGIC, 3) != 0) {
+			fprintf(stderr, "%s: %s: broken record\n", __func__,
+			    fn);
+			return (0);
+		}
+		rec->flags = h[3];
+		rec->chanid = record_get32(h + 4);
+		linklen = record_get32(h + 24);
+		rec->len = record_get32(h + 28);
+		stored = record_get32(h + 32);
+		/* the lengths size the buffers, see record_body() */
+		if (linklen > REPLAY_LINK_MAX ||
+		    (rec->flags & RECORD_COMPRESSED ? stored >= rec->len :
+		    stored != rec->len)) {
+			fprintf(stderr, "%s: %s: broken record\n", __func__,
+			    fn);
+			return (0);
+		}
+		if (rec->len <= max)
+			break;
+		fprintf(stderr, "%s: %s: channel %d: body of %zu bytes over "
+		    "the limit, skipped\n", __func__, fn, rec->chanid,
+		    rec->len);
+		if (fseeko(fp, (off_t)linklen + stored, SEEK_CUR) != 0)
+			return (0);
+	}
+	rec->rss = NULL;
+	rec->sniff = RSS_SNIFF_UNKNOWN;
+	rec->body = empty_blob;
+	blob_resize(&rec->body, stored);
+	if (fseeko(fp, linklen, SEEK_CUR) != 0 ||
+	    fread(blob_buffer(&rec->body), 1, stored, fp) != stored) {
+		fprintf(stderr, "%s: %s: short record\n", __func__, fn);
+		blob_reset(&rec->body);
+		return (0);
+	}
+	return (1);
+}
+
+static void
+replay_parse(struct replay_record *rec, int maxitems)
+{
+	Blob raw = empty_blob;
+	uLongf len = rec->len;
+
+	if (rec->flags & RECORD_COMPRESSED) {
+		blob_resize(&raw, rec->len);
+		if (uncompress((unsigned char *)blob_buffer(&raw), &len,
+		    (unsigned char *)blob_buffer(&rec->body),
+		    blob_size(&rec->body)) != Z_OK || len != rec->len) {
+			blob_reset(&raw);
+			return;
+		}
+		blob_reset(&rec->body);
+		rec->body = raw;
+	}
+	rec->sniff = rss_sniff(blob_buffer(&rec->body), blob_size(&rec->body));
+	if (rec->sniff == RSS_SNIFF_REJECT)
+		return;
+	rec->rss = rss_parse_buffer(blob_buffer(&rec->body),
+	    blob_size(&rec->body), maxitems, rec->flags & RECORD_TRUNCATED);
+}
+
+static void *
+replay_thread(void *arg)
+{
+	struct replay_batch *batch = arg;
+	int i;
+
+	for (;;) {
+		pthread_mutex_lock(&batch->lock);
+		i = batch->next++;
+		pthread_mutex_unlock(&batch->lock);
+		if (i >= batch->count)
+			break;
+		replay_parse(&batch->recs[i], batch->maxitems);
+	}
+	return (NULL);
+}
+
+/* parse the batch with threads, then store it in archive order */
+static int
+replay_batch(struct replay_batch *batch, int threads)
+{
+	struct replay_record *rec;
+	pthread_t *tid;
+	int i, started, tagid, count = 0, added;
+
+	if ((tid = calloc(threads ? threads : 1, sizeof(pthread_t))) == NULL) {
+		fprintf(stderr, "%s: %s\n", __func__, strerror(errno));
+		exit(1);
+	}
+	batch->next = 0;
+	for (started = 0; started < threads && started < batch->count;
+	    started++) {
+		if (pthread_create(&tid[started], NULL, replay_thread,
+		    batch) != 0)
+			break;
+	}
+	/* no thread, parse here */
+	if (started == 0)
+		replay_thread(batch);
+	for (i = 0; i < started; i++)
+		pthread_join(tid[i], NULL);
+	free(tid);
+
+	db_multi_exec("BEGIN");
+	for (i = 0; i < batch->count; i++) {
+		rec = &batch->recs[i];
+		tagid = db_int(-1, "SELECT tagid FROM channels WHERE id = %d",
+		    rec->chanid);
+		metrics_sniff(rec->sniff);
+		if (rec->sniff == RSS_SNIFF_REJECT) {
+			printf("rss id [%d] is not a feed.\n", rec->chanid);
+		} else if (rec->rss == NULL) {
+			printf("rss id [%d] cannot be parsed.\n", rec->chanid);
+			metrics_add(M_PARSE_ERRORS, 1);
+		} else if (tagid == -1) {
+			dmsg(0, "%s: unknown channel %d", __func__,
+			    rec->chanid);
+			rss_close(rec->rss);
+		} else if ((added = store_feed(rec->chanid, rec->rss)) > 0) {
+			summary_mark(tagid);
+			count += added;
+		}
+		blob_reset(&rec->body);
+	}
+	db_multi_exec("COMMIT");
+	batch->count = 0;
+	return (count);
+}
+
+static int
+replay_segment_cmp(const void *a, const void *b)
+{
+	return (strcmp(*(char * const *)a, *(char * const *)b));
+}
+
+/* replay all segments of dir, returns the number of new items */
+int
+replay_run(const char *dir, int threads, size_t body_max, int maxitems)
+{
+	struct replay_record recs[REPLAY_BATCH];
+	struct replay_batch batch;
+	struct dirent *de;
+	uint64_t start = metrics_now(), bytes = 0, elapsed;
+	char **files = NULL, fn[512];
+	int i, nfiles = 0, records = 0, count = 0;
+	FILE *fp;
+	DIR *dp;
+
+	if ((dp = opendir(dir)) == NULL) {
+		fprintf(stderr, "%s: %s: %s\n", __func__, dir, strerror(errno));
+		return (-1);
+	}
+	while ((de = readdir(dp)) != NULL) {
+		i = strlen(de->d_name);
+		if (i < 5 || strcmp(de->d_name + i - 4, ".rrs") != 0)
+			continue;
+		if ((files = realloc(files, (nfiles + 1) * sizeof(char *))) ==
+		    NULL || (files[nfiles++] = strdup(de->d_name)) == NULL) {
+			fprintf(stderr, "%s: %s\n", __func__, strerror(errno));
+			exit(1);
+		}
+	}
+	closedir(dp);
+	/* the names start with the time the segment was started */
+	qsort(files, nfiles, sizeof(char *), replay_segment_cmp);
+
+	xmlInitParser();
+	pthread_mutex_init(&batch.lock, NULL);
+	batch.recs = recs;
+	batch.count = 0;
+	batch.maxitems = maxitems;
+	for (i = 0; i < nfiles; i++) {
+		snprintf(fn, sizeof(fn), "%s/%s", dir, files[i]);
+		dmsg(0, "%s: %s", __func__, fn);
+		if ((fp = fopen(fn, "r")) == NULL) {
+			fprintf(stderr, "%s: %s: %s\n", __func__, fn,
+			    strerror(errno));
+			continue;
+		}
+		while (replay_read(fp, fn, &recs[batch.count], body_max)) {
+			bytes += recs[batch.count].len;
+			records++;
+			if (++batch.count == REPLAY_BATCH)
+				count += replay_batch(&batch, threads);
+		}
+		fclose(fp);
+		free(files[i]);
+	}
+	if (batch.count)
+		count += replay_batch(&batch, threads);
+	pthread_mutex_destroy(&batch.lock);
+	free(files);
+
+	elapsed = metrics_now() - start;
+	printf("%d records, %llu bytes replayed in %.3f s "
+	    "(%.2f MB/s, %.0f records/s), %d new items.\n", records,
+	    (unsigned long long)bytes, elapsed / 1e6,
+	    elapsed ? bytes / (elapsed / 1e6) / 1e6 : 0,
+	    elapsed ? records / (elapsed / 1e6) : 0, count);
+	return (count);
+}
@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2026 Nikola Kolev <koue@chaosophia.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/*
+ * Archive retention.
+ *
+ * Tags and channels may limit the age (keepdays) and the number
+ * (keepitems) of their items, NULL means no limit. The age of the items
+ * without publication date is counted from their ingest time. Items past
+ * a limit are moved from feeds into feeds_archive with compressed
+ * description (see zdesc.c, short descriptions are stored as they are),
+ * in batches of RETENTION_BATCH items per transaction. Each batch is
+ * followed by an incremental vacuum of RETENTION_PAGES pages, the hot
+ * table stays small and the database file doesn't keep the freed pages
+ * forever.
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#include <fslbase.h>
+#include <fsldb.h>
+#include <sqlite3.h>
+
+#include "rss.h"
+
+#define	RETENTION_BATCH		256
+#define	RETENTION_PAGES		64
+
+/* collect ids of the items past the limits */
+static void
+retention_collect(const char *table, const char *scope)
+{
+	time_t now = time(NULL);
+	char *where;
+	Stmt q;
+
+	db_prepare(&q, "SELECT id, keepdays, keepitems FROM %s "
+			"WHERE keepdays IS NOT NULL OR keepitems IS NOT NULL",
+			table);
+	while (db_step(&q) == SQLITE_ROW) {
+		where = mprintf(scope, db_column_int(&q, 0));
+		if (db_column_type(&q, 1) != SQLITE_NULL) {
+			db_multi_exec("INSERT OR IGNORE INTO retention "
+			    "SELECT id FROM feeds WHERE %s AND "
+			    "CASE WHEN CAST(pubdate AS INTEGER) > 0 "
+			    "THEN CAST(pubdate AS INTEGER) "
+			    "ELSE ingested END < %ld",
+			    where,
+			    (long)(now - db_column_int64(&q, 1) * 24 * 60 * 60));
+		}
+		if (db_column_type(&q, 2) != SQLITE_NULL) {
+			db_multi_exec("INSERT OR IGNORE INTO retention "
+			    "SELECT id FROM feeds WHERE %s "
+			    "ORDER BY id DESC LIMIT -1 OFFSET %d",
+			    where, db_column_int(&q, 2));
+		}
+		fossil_free(where);
+	}
+	db_finalize(&q);
+}
+
+/* move next batch into the archive, returns number of moved items */
+static int
+retention_move(long *last)
+{
+	Blob zdesc = empty_blob;
+	Stmt q, ins;
+	long first = *last;
+	int count = 0;
+
+	db_multi_exec("BEGIN");
+	db_prepare(&q, "SELECT f.id, f.chanid, f.modified, f.link, f.title, "
+			"f.description, f.pubdate "
+			"FROM retention AS r JOIN feeds AS f ON f.id = r.id "
+			"WHERE r.id > %ld ORDER BY r.id LIMIT %d",
+			first, RETENTION_BATCH);
+	while (db_step(&q) == SQLITE_ROW) {
+		*last = db_column_int64(&q, 0);
+		db_prepare(&ins, "INSERT INTO feeds_archive (id, chanid, "
+				"modified, link, title, description, pubdate) "
+				"VALUES (%ld, %d, %lld, %Q, %Q, :desc, %Q)",
+				*last, db_column_int(&q, 1),
+				db_column_int64(&q, 2), db_column_text(&q, 3),
+				db_column_text(&q, 4), db_column_text(&q, 6));
+		if (db_column_type(&q, 5) == SQLITE_BLOB) {
+			/* already compressed */
+			blob_append(&zdesc, db_column_raw(&q, 5),
+			    db_column_bytes(&q, 5));
+			db_bind_blob(&ins, ":desc", &zdesc);
+		} else if (zdesc_compress(&zdesc, db_column_text(&q, 5)) == 0) {
+			db_bind_blob(&ins, ":desc", &zdesc);
+		} else {
+			db_bind_text(&ins, ":desc", db_column_text(&q, 5));
+		}
+		db_step(&ins);
+		db_finalize(&ins);
+		blob_reset(&zdesc);
+		count++;
+	}
+	db_finalize(&q);
+	db_multi_exec("DELETE FROM feeds WHERE id IN "
+			"(SELECT id FROM retention WHERE id > %ld AND id <= %ld)",
+			first, *last);
+	db_multi_exec("COMMIT");
+	db_multi_exec("PRAGMA incremental_vacuum(%d)", RETENTION_PAGES);
+	return (count);
+}
+
+void
+retention_run(void)
+{
+	long last = 0;
+	int count, total = 0;
+
+	dmsg(0, "%s: start", __func__);
+	db_multi_exec("CREATE TEMP TABLE retention (id INTEGER PRIMARY KEY)");
+	retention_collect("channels", "chanid = %d");
+	retention_collect("tags",
+	    "chanid IN (SELECT id FROM channels WHERE tagid = %d)");
+	do {
+		count = retention_move(&last);
+		total += count;
+	} while (count == RETENTION_BATCH);
+	db_multi_exec("DROP TABLE retention");
+	if (total)
+		printf("%d feeds have been archived.\n", total);
+	dmsg(0, "%s: end", __func__);
+}
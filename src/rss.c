@@ -29,8 +29,11 @@
  */
 
 #include <errno.h>
+#include <limits.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
 
 #include "rss.h"
@@ -86,6 +89,26 @@ rss_close(struct feed *rss)
 	return (0);
 }
 
+/*
+ * Links of the feed: the site (rss content, atom rel="alternate") and the
+ * WebSub <link rel="hub"> and <link rel="self">.
+ */
+static void
+rss_link(struct feed *rss, xmlNode *node)
+{
+	char *rel;
+
+	if ((rel = xml_get_value(rss->pool, node, "rel")) == NULL ||
+	    strcmp(rel, "alternate") == 0) {
+		if (rss->url == NULL &&
+		    (rss->url = xml_get_value(rss->pool, node, "href")) == NULL)
+			rss->url = xml_get_content(rss->pool, node);
+	} else if (strcmp(rel, "hub") == 0 && rss->hub == NULL)
+		rss->hub = xml_get_value(rss->pool, node, "href");
+	else if (strcmp(rel, "self") == 0 && rss->self == NULL)
+		rss->self = xml_get_value(rss->pool, node, "href");
+}
+
 static void
 rss_channel(struct feed *rss, xmlNode *pnode)
 {
@@ -99,6 +122,10 @@ rss_channel(struct feed *rss, xmlNode *pnode)
 			rss->title = xml_get_content(pool, pnode);
 		} else if (xml_isnode(pnode, "description", 0)) {
 			rss->desc = xml_get_content(pool, pnode);
+		} else if (xml_isnode(pnode, "link", 0)) {
+			rss_link(rss, pnode);
+		} else if (xml_isnode(pnode, "language", 0)) {
+			rss->language = xml_get_content(pool, pnode);
 		} else {
                         xml_isnode_date(pnode, &rss->date);
                 }
@@ -193,9 +220,20 @@ rss_head(struct feed *rss, xmlNode *node)
 			rss->title = xml_get_content(pool, node);
 		} else if (xml_isnode(node, "description", 0)) {
 			rss->desc = xml_get_content(pool, node);
+		} else if (xml_isnode(node, "link", 0)) {
+			rss_link(rss, node);
+		} else if (xml_isnode(node, "language", 0)) {
+			rss->language = xml_get_content(pool, node);
 		} else if (xml_isnode(node, "channel", 0) && (rss->version == RSS_V1_0)) {
 			rss_channel(rss, node->xmlChildrenNode);
 		} else if (xml_isnode(node, "item", 0) || xml_isnode(node, "entry", 0)) {
+			/* keep the first (newest) items only */
+			if (rss->maxitems && rss->count == rss->maxitems) {
+				rss->truncated = 1;
+				node = node->next;
+				continue;
+			}
+			rss->count++;
 			if (rss_entry(rss, node->xmlChildrenNode) == -1) {
 				xmlFreeDoc(doc);
 				rss_close(rss);
@@ -212,12 +250,11 @@ rss_head(struct feed *rss, xmlNode *node)
 }
 
 static int
-rss_version_atom(struct pool *pool, xmlNode *node)
+rss_version_atom(const char *p)
 {
 	int version = ATOM_V0_1;	//default
-	char *p = NULL;
 
-	if ((p = xml_get_value(pool, node, "version")) == NULL)
+	if (p == NULL)
 		goto done;
 	else if (strcmp(p, "0.3") == 0)
 		version = ATOM_V0_3;
@@ -228,12 +265,11 @@ done:
 }
 
 static int
-rss_version_rss(struct pool *pool, xmlNode *node)
+rss_version_rss(const char *p)
 {
 	int version = -1;
-	char *p = NULL;
 
-	if ((p = xml_get_value(pool, node, "version")) == NULL)
+	if (p == NULL)
 		goto done;
 	else if (strcmp(p, "0.91") == 0)
 		version = RSS_V0_91;
@@ -263,9 +299,11 @@ rss_demux(struct feed *rss, xmlNode *node)
 	else if (xml_isnode(node, "html", 0)) // not xml
 		goto done;
 	else if (xml_isnode(node, "feed", 0)) {
-		version = rss_version_atom(pool, node);
+		version = rss_version_atom(xml_get_value(pool, node,
+		    "version"));
 	} else if (xml_isnode(node, "rss", 0)) {
-		version = rss_version_rss(pool, node);
+		version = rss_version_rss(xml_get_value(pool, node,
+		    "version"));
 	} else if (xml_isnode(node, "rdf", 0) || xml_isnode(node, "RDF", 0)) {
 		version = RSS_V1_0;
 	}
@@ -274,37 +312,321 @@ done:
 	return (version);
 }
 
-struct feed *
-rss_parse(const char *xmlstream, int isfile)
+#define	RSS_SNIFF_SPACE(c)	((c) == ' ' || (c) == '\t' || (c) == '\r' || \
+				    (c) == '\n')
+
+/* end of the markup started at p, NULL if it does not end before end */
+static const char *
+rss_sniff_skip(const char *p, const char *end, const char *close)
 {
-	struct feed *rss;
-	xmlNode *node;
-	xmlDoc *doc;
+	size_t n = strlen(close);
 
-	dmsg(1, "%s: start", __func__);
+	for (; p + n <= end; p++) {
+		if (memcmp(p, close, n) == 0)
+			return (p + n);
+	}
+	return (NULL);
+}
 
-	if ((rss = feed_create()) == NULL)
+/*
+ * Value of attribute name of the tag at p, the tag name already skipped.
+ * Returns 1 if found, 0 if the tag has no such attribute and -1 if the
+ * tag does not end before end.
+ */
+static int
+rss_sniff_attr(const char *p, const char *end, const char *name,
+    char *value, size_t size)
+{
+	const char *attr;
+	size_t n, len = strlen(name);
+	char quote;
+
+	for (;;) {
+		while (p < end && RSS_SNIFF_SPACE(*p))
+			p++;
+		if (p == end)
+			return (-1);
+		if (*p == '>' || *p == '/')
+			return (0);
+		for (attr = p; p < end && *p != '=' && !RSS_SNIFF_SPACE(*p) &&
+		    *p != '>'; p++)
+			;
+		n = p - attr;
+		while (p < end && RSS_SNIFF_SPACE(*p))
+			p++;
+		if (p == end)
+			return (-1);
+		if (*p != '=')
+			continue;
+		for (p++; p < end && RSS_SNIFF_SPACE(*p); p++)
+			;
+		if (p == end)
+			return (-1);
+		if (*p != '"' && *p != '\'')
+			return (0);
+		quote = *p++;
+		for (attr = (n == len && memcmp(attr, name, len) == 0) ?
+		    p : NULL; p < end && *p != quote; p++)
+			;
+		if (p == end)
+			return (-1);
+		if (attr) {
+			n = (size_t)(p - attr) < size ? (size_t)(p - attr) :
+			    size - 1;
+			memcpy(value, attr, n);
+			value[n] = 0;
+			return (1);
+		}
+		p++;
+	}
+}
+
+/*
+ * Tell the feed version from the first RSS_SNIFF_LEN bytes of body, the
+ * way rss_demux() does from the root element of the parsed document.
+ * Error pages and the like are rejected before the parser runs. Returns
+ * RSS_SNIFF_REJECT if body is not a feed and RSS_SNIFF_UNKNOWN if the
+ * head is not enough to tell (or is not ASCII compatible).
+ */
+int
+rss_sniff(const char *buf, size_t len)
+{
+	const char *p = buf, *end, *name;
+	char value[16];
+	size_t n;
+	int depth, whole = (len <= RSS_SNIFF_LEN), rc;
+
+	end = buf + (whole ? len : RSS_SNIFF_LEN);
+	if (end - p >= 3 && memcmp(p, "\xef\xbb\xbf", 3) == 0)
+		p += 3;
+	/* UTF-16/32 */
+	if (end - p >= 2 && (p[0] == 0 || p[1] == 0 ||
+	    (unsigned char)p[0] >= 0xfe))
+		return (RSS_SNIFF_UNKNOWN);
+	for (;;) {
+		while (p < end && RSS_SNIFF_SPACE(*p))
+			p++;
+		if (p == end)
+			break;
+		if (*p != '<')
+			return (RSS_SNIFF_REJECT);
+		if (end - p >= 4 && memcmp(p, "<!--", 4) == 0) {
+			p = rss_sniff_skip(p + 4, end, "-->");
+		} else if (end - p >= 2 && memcmp(p, "<?", 2) == 0) {
+			p = rss_sniff_skip(p + 2, end, "?>");
+		} else if (end - p >= 2 && memcmp(p, "<!", 2) == 0) {
+			/* doctype, with internal subset */
+			for (p += 2, depth = 0; p < end &&
+			    (*p != '>' || depth > 0); p++) {
+				if (*p == '[')
+					depth++;
+				else if (*p == ']')
+					depth--;
+			}
+			p = (p < end) ? p + 1 : NULL;
+		} else
+			goto root;
+		if (p == NULL)
+			break;
+	}
+	/* no root element in the whole body */
+	return (whole ? RSS_SNIFF_REJECT : RSS_SNIFF_UNKNOWN);
+root:
+	for (name = ++p; p < end && !RSS_SNIFF_SPACE(*p) && *p != '>' &&
+	    *p != '/'; p++)
+		;
+	if (p == end)
+		return (RSS_SNIFF_UNKNOWN);
+	n = p - name;
+	/* the namespace prefix does not count, like in the tree */
+	if (memchr(name, ':', n) != NULL) {
+		n -= (const char *)memchr(name, ':', n) + 1 - name;
+		name = p - n;
+	}
+	if (n == 4 && memcmp(name, "feed", 4) == 0) {
+		if ((rc = rss_sniff_attr(p, end, "version", value,
+		    sizeof(value))) == -1)
+			return (RSS_SNIFF_UNKNOWN);
+		return (rss_version_atom(rc ? value : NULL));
+	} else if (n == 3 && memcmp(name, "rss", 3) == 0) {
+		if ((rc = rss_sniff_attr(p, end, "version", value,
+		    sizeof(value))) == -1)
+			return (RSS_SNIFF_UNKNOWN);
+		return (rss_version_rss(rc ? value : NULL));
+	} else if (n == 3 && (memcmp(name, "rdf", 3) == 0 ||
+	    memcmp(name, "RDF", 3) == 0))
+		return (RSS_V1_0);
+	return (RSS_SNIFF_REJECT);
+}
+
+/*
+ * Validate UTF-8. Runs of ASCII are skipped a word at a time, which is
+ * the whole body for most of the feeds.
+ */
+static int
+rss_utf8_valid(const unsigned char *p, size_t len)
+{
+	const unsigned char *end = p + len;
+	static const uint32_t min[] = { 0, 0x80, 0x800, 0x10000 };
+	uint64_t word;
+	uint32_t cp;
+	int need, n;
+
+	while (p < end) {
+		while ((size_t)(end - p) >= sizeof(word)) {
+			memcpy(&word, p, sizeof(word));
+			if (word & 0x8080808080808080ULL)
+				break;
+			p += sizeof(word);
+		}
+		if (p == end)
+			break;
+		if (*p < 0x80) {
+			p++;
+			continue;
+		} else if ((*p & 0xe0) == 0xc0) {
+			cp = *p & 0x1f;
+			n = 1;
+		} else if ((*p & 0xf0) == 0xe0) {
+			cp = *p & 0x0f;
+			n = 2;
+		} else if ((*p & 0xf8) == 0xf0) {
+			cp = *p & 0x07;
+			n = 3;
+		} else
+			return (0);
+		if (end - p <= n)
+			return (0);
+		for (need = n, p++; n > 0; n--, p++) {
+			if ((*p & 0xc0) != 0x80)
+				return (0);
+			cp = (cp << 6) | (*p & 0x3f);
+		}
+		/* overlong, surrogate or out of range */
+		if ((cp < min[need]) || (cp >= 0xd800 && cp <= 0xdfff) ||
+		    (cp > 0x10ffff))
+			return (0);
+	}
+	return (1);
+}
+
+/*
+ * Encoding from the XML declaration, NULL when missing.
+ */
+static char *
+rss_declared(char *enc, size_t size, const char *buf, size_t len)
+{
+	const char *p, *end;
+	char quote;
+	size_t n;
+
+	if (len < 6 || memcmp(buf, "<?xml", 5) != 0)
+		return (NULL);
+	if ((end = memchr(buf, '>', len)) == NULL)
 		return (NULL);
+	for (p = buf + 5; p + 9 < end; p++) {
+		if (memcmp(p, "encoding", 8) != 0)
+			continue;
+		for (p += 8; p < end && (*p == ' ' || *p == '='); p++)
+			;
+		if (p == end || (*p != '"' && *p != '\''))
+			return (NULL);
+		quote = *p++;
+		for (n = 0; p + n < end && p[n] != quote && n < size - 1; n++)
+			enc[n] = p[n];
+		enc[n] = 0;
+		return (enc);
+	}
+	return (NULL);
+}
 
-	doc = rss->doc;
-	if (isfile)
-		doc = xmlParseFile(xmlstream);
-	else
-		doc = xmlParseDoc((const xmlChar *)xmlstream);
+/*
+ * Length of a body cut at the size limit without the incomplete multibyte
+ * sequence at its end, the rest is validated as usual.
+ */
+static size_t
+rss_utf8_trim(const char *buf, size_t len)
+{
+	const unsigned char *p = (const unsigned char *)buf;
+	size_t i, need;
+
+	for (i = len; i > 0 && len - i < 4; i--) {
+		if ((p[i - 1] & 0xc0) == 0x80)
+			continue;
+		if ((p[i - 1] & 0xe0) == 0xc0)
+			need = 2;
+		else if ((p[i - 1] & 0xf0) == 0xe0)
+			need = 3;
+		else if ((p[i - 1] & 0xf8) == 0xf0)
+			need = 4;
+		else
+			return (len);
+		return (len - (i - 1) < need ? i - 1 : len);
+	}
+	return (len);
+}
+
+/*
+ * Pick the encoding the parser has to use.
+ *
+ * Valid UTF-8 is parsed as UTF-8 whatever the declaration says, libxml2
+ * does not run any conversion then. Other bodies are transcoded as
+ * declared. A body which is not UTF-8 but claims to be, or does not
+ * declare anything, is most likely windows-1252.
+ */
+static const char *
+rss_encoding(const char *buf, size_t len)
+{
+	const unsigned char *p = (const unsigned char *)buf;
+	char enc[32];
+
+	/* UTF-16/32 is detected from the BOM */
+	if (len >= 2 && ((p[0] == 0xfe && p[1] == 0xff) ||
+	    (p[0] == 0xff && p[1] == 0xfe)))
+		return (NULL);
+	if (len >= 3 && p[0] == 0xef && p[1] == 0xbb && p[2] == 0xbf) {
+		p += 3;
+		len -= 3;
+	}
+	if (rss_utf8_valid(p, len))
+		return ("UTF-8");
+	if (rss_declared(enc, sizeof(enc), (const char *)p, len) != NULL &&
+	    strcasecmp(enc, "UTF-8") != 0 && strcasecmp(enc, "UTF8") != 0)
+		return (NULL);
+	dmsg(0, "%s: invalid UTF-8, assuming windows-1252", __func__);
+	if (xmlFindCharEncodingHandler("windows-1252") != NULL)
+		return ("windows-1252");
+	return ("ISO-8859-1");
+}
+
+static struct feed *
+rss_build(xmlDoc *doc, int maxitems)
+{
+	struct feed *rss;
+	xmlNode *node;
+	xmlChar *lang;
 
 	if (doc == NULL) {
 		fprintf(stderr, "%s: cannot read stream\n", __func__);
-		goto fail;
+		return (NULL);
 	}
 
+	if ((rss = feed_create()) == NULL)
+		goto faildoc;
+
 	if ((node = xmlDocGetRootElement(doc)) == NULL) {
 		fprintf (stderr, "%s: empty document\n", __func__);
-		goto faildoc;
+		goto fail;
 	}
 
 	if ((rss->version = rss_demux(rss, node)) == -1) {
 		fprintf (stderr, "%s: unknown document\n", __func__);
-		goto faildoc;
+		goto fail;
+	}
+	/* atom has the language in xml:lang, rss in <language> */
+	if ((lang = xmlNodeGetLang(node)) != NULL) {
+		rss->language = pool_strdup(rss->pool, (char *)lang);
+		xmlFree(lang);
 	}
 
 	node = node->xmlChildrenNode;
@@ -313,48 +635,95 @@ rss_parse(const char *xmlstream, int isfile)
 
 	if (node == NULL) {
 		fprintf(stderr, "%s: bad document\n", __func__);
-		goto faildoc;
+		goto fail;
 	} else if (rss->version < ATOM_V0_1) {
 		if (xml_isnode(node, "channel", 0) == 0) {
 			fprintf (stderr, "%s: bad document: channel missing\n", __func__);
-			goto faildoc;
+			goto fail;
 		} else if (rss->version != RSS_V1_0) // document is RSS
 			node = node->xmlChildrenNode;
 	}
 
+	rss->maxitems = maxitems;
 	rss_head(rss, node);
 	if (debug > 1) {
 		rss_sanity_check(rss);
 		fflush(stdout);
 	}
 
-	dmsg(1, "%s: end", __func__);
 	xmlFreeDoc(doc);
 	return (rss);
 
-faildoc:
-	xmlFreeDoc(doc);
-
 fail:
 	feed_free(rss);
+
+faildoc:
+	xmlFreeDoc(doc);
 	return (NULL);
 }
 
+/*
+ * Parse feed body of len bytes, the buffer need not be NUL terminated.
+ * Up to maxitems items are kept (0 for all). A truncated body is parsed
+ * in recovery mode, the items up to the cut are kept.
+ */
+struct feed *
+rss_parse_buffer(const char *buf, size_t len, int maxitems, int truncated)
+{
+	struct feed *rss;
+	struct item *item;
+
+	dmsg(1, "%s: start", __func__);
+	if (len > INT_MAX) {
+		fprintf(stderr, "%s: body too big\n", __func__);
+		return (NULL);
+	}
+	if (truncated)
+		len = rss_utf8_trim(buf, len);
+	rss = rss_build(xmlReadMemory(buf, (int)len, NULL,
+	    rss_encoding(buf, len), truncated ? XML_PARSE_RECOVER : 0),
+	    maxitems);
+	/* the last item may be cut in the middle, unless the limit hit first */
+	if (rss && truncated) {
+		if (!rss->truncated &&
+		    (item = TAILQ_FIRST(&rss->items_list)) != NULL)
+			TAILQ_REMOVE(&rss->items_list, item, entry);
+		rss->truncated = 1;
+	}
+	dmsg(1, "%s: end", __func__);
+	return (rss);
+}
+
+struct feed *
+rss_parse(const char *xmlstream, int isfile)
+{
+	struct feed *rss;
+
+	dmsg(1, "%s: start", __func__);
+	if (isfile)
+		rss = rss_build(xmlParseFile(xmlstream), 0);
+	else
+		rss = rss_parse_buffer(xmlstream, strlen(xmlstream), 0, 0);
+	dmsg(1, "%s: end", __func__);
+	return (rss);
+}
+
 /* debug message out */
 void
-dmsg(int verbose, const char *fmt, ...)
+dmsg_print(const char *fmt, ...)
 {
-	if (debug > verbose) {
-		va_list ap;
-		time_t t = time(NULL);
-		struct tm *tm = gmtime(&t);
-		fprintf(stdout, "%4.4d.%2.2d.%2.2d %2.2d:%2.2d:%2.2d ",
-		    tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday, tm->tm_hour,
-		    tm->tm_min, tm->tm_sec);
-		va_start(ap, fmt);
-		vfprintf(stdout, fmt, ap);
-		va_end(ap);
-		fprintf(stdout, "\n");
-		fflush(stdout);
-	}
+	char stamp[32];
+	struct tm tm;
+	va_list ap;
+	time_t t = time(NULL);
+
+	/* called by the worker threads too, one line at a time */
+	strftime(stamp, sizeof(stamp), "%Y.%m.%d %H:%M:%S ", gmtime_r(&t, &tm));
+	flockfile(stdout);
+	fputs(stamp, stdout);
+	va_start(ap, fmt);
+	vfprintf(stdout, fmt, ap);
+	va_end(ap);
+	fputc('\n', stdout);
+	funlockfile(stdout);
 }
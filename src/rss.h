@@ -32,6 +32,7 @@
 #define _RSS_H_
 
 #include <sys/queue.h>
+#include <stdint.h>
 #include <libxml/parser.h>
 #include <libxml/tree.h>
 #include <time.h>
@@ -58,8 +59,12 @@ struct item {
 	char *title;
 	char *url;
 	char *desc;
+	size_t desclen;		/* compressed desc only */
+	int compressed;
 	time_t date;
 	long chanid;
+	char *channel;		/* channel title, index.cgi only */
+	char *site;		/* channel link, index.cgi only */
 	TAILQ_ENTRY(item) entry;
 };
 
@@ -69,17 +74,140 @@ struct feed {
 	char *title;
 	char *url;
 	char *desc;
+	char *language;
+	char *hub;		/* WebSub hub */
+	char *self;		/* WebSub topic */
 	time_t date;
 	xmlDoc *doc;
+	int maxitems;		/* 0 for all */
+	int count;
+	int truncated;		/* body or items cut */
 	TAILQ_HEAD(items_list, item) items_list;
 };
 
+/* rss_sniff() looks at this many bytes of the body */
+#define	RSS_SNIFF_LEN		4096
+#define	RSS_SNIFF_REJECT	(-1)
+#define	RSS_SNIFF_UNKNOWN	(-2)
+
+int rss_sniff(const char *buf, size_t len);
 struct feed *rss_parse(const char *xmlstream, int isfile);
+struct feed *rss_parse_buffer(const char *, size_t, int, int);
 int rss_close(struct feed *rss);
 
 extern int debug;
-void dmsg(int, const char *fmt, ...);
+void dmsg_print(const char *fmt, ...);
+/* disabled debug output costs a branch only */
+#define	dmsg(verbose, ...)	do {					\
+	if (debug > (verbose))						\
+		dmsg_print(__VA_ARGS__);				\
+} while (0)
+
+enum {
+	M_CHANNELS,
+	M_CHANNELS_FAILED,
+	M_CHANNELS_TRUNCATED,
+	M_CHANNELS_BACKOFF,
+	M_HOSTS,
+	M_HOSTS_UNRESOLVED,
+	M_BODY_BYTES,
+	M_BODY_INFLATED_BYTES,
+	M_SNIFF_RSS,
+	M_SNIFF_RDF,
+	M_SNIFF_ATOM,
+	M_SNIFF_UNKNOWN,
+	M_SNIFF_REJECTED,
+	M_PARSE_ERRORS,
+	M_ITEMS_PARSED,
+	M_ITEMS_NEW,
+	M_ITEMS_DUPLICATE,
+	M_ITEMS_NEAR_DUPLICATE,
+	METRICS_COUNTERS
+};
+
+enum {
+	T_RESOLVE,
+	T_FETCH_CONNECT,
+	T_FETCH_TRANSFER,
+	T_PARSE,
+	T_SQL_CHECK_LINK,
+	T_SQL_SIMHASH,
+	T_SQL_ADD_FEED,
+	T_RUN,
+	METRICS_TIMERS
+};
+
+void metrics_add(int counter, uint64_t n);
+void metrics_sniff(int sniff);
+uint64_t metrics_now(void);
+void metrics_time(int timer, uint64_t start);
+int metrics_write(const char *path);
 
 struct item *item_create(struct pool *pool);
 
+/* descriptions longer than HTML_SUMMARY_MIN get a summary for list pages */
+#define HTML_SUMMARY_MIN	4096
+#define HTML_SUMMARY_LEN	1024
+
+struct Blob;
+int body_read(struct Blob *body, FILE *fp, size_t max);
+
+void html_text(struct Blob *out, const char *html);
+void html_sanitize(struct Blob *out, const char *html);
+void html_summary(struct Blob *out, const char *text, size_t len);
+
+uint64_t simhash(const char *title, const char *desc);
+long simhash_seen(uint64_t hash);
+void simhash_store(long feedid, uint64_t hash);
+
+void retention_run(void);
+
+void add_feed(int chan_id, char *item_url, char *item_title, char *item_desc,
+    time_t item_date, uint64_t item_hash, long duplicate);
+int check_link(int chan_id, char *item_link, time_t item_pubdate);
+int fetch_channel(int id, time_t modified, const char *link);
+int store_feed(int chan_id, struct feed *rss);
+
+const char *crawl_error(int code);
+void crawl_result(int id, const char *error, const char *status);
+void crawl_add(int id, time_t modified, const char *link, long tagid);
+void crawl_resolve(int threads);
+void crawl_run(int delay);
+
+void record_open(const char *dir);
+void record_body(int chanid, const char *link, time_t modified, int truncated,
+    struct Blob *body);
+void record_close(void);
+int replay_run(const char *dir, int threads, size_t body_max,
+    int maxitems);
+
+int ingest_run(const char *arg, int threads, int maxitems);
+
+int opml_import(const char *path, int threads, size_t body_max, int maxitems);
+int opml_export(const char *path);
+
+void websub_open(const char *callback);
+void websub_discover(int chanid, const char *hub, const char *topic);
+void websub_subscribe(void);
+void websub_serve(const char *listen_on, size_t body_max, int maxitems,
+    const char *htmldir, const char *outdir, int items);
+
+extern int shard_staging;
+int shard_parse(const char *arg, int *k, int *n);
+void shard_open(const char *dbname, int k);
+void shard_store(int chan_id, const char *url, const char *title,
+    const char *desc, time_t date, uint64_t hash);
+void shard_channel(int chan_id, struct feed *rss);
+int shard_merge(const char *path);
+
+struct Stmt;
+void zdesc_init(void);
+int zdesc_compress(struct Blob *out, const char *text);
+int zdesc_write(FILE *out, const char *zdesc, int size);
+void zdesc_column(struct Stmt *q, int col, struct Blob *out);
+void zdesc_train(void);
+
+void summary_mark(long tagid);
+void summary_update(const char *htmldir, const char *outdir, int count);
+
 #endif /* _RSS_H_ */
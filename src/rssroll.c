@@ -47,16 +47,60 @@ int debug = 0;
 /* rss database store	*/
 Global g;
 
+/* per feed limits, see -b and -i */
+static size_t body_max = 16 * 1024 * 1024;
+static int items_max = 1000;
+
 /* add new item into the database */
 void
 add_feed(int chan_id, char *item_url, char *item_title, char *item_desc,
-    time_t item_date)
+    time_t item_date, uint64_t item_hash, long duplicate)
 {
+	Blob text = empty_blob, zdesc = empty_blob, summary = empty_blob;
+	uint64_t start;
+	long id;
+	Stmt q;
+
 	dmsg(0, "%s: %s", __func__, item_url);
-	db_multi_exec("INSERT INTO feeds (chanid, modified, link, title, "
-					"description, pubdate) "
-			"VALUES (%d, 0, '%q', '%q', '%q', '%ld')",
-			 chan_id, item_url, item_title, item_desc, item_date);
+	if (shard_staging) {
+		shard_store(chan_id, item_url, item_title, item_desc,
+		    item_date, item_hash);
+		printf("New feed has been staged %s.\n", item_url);
+		return;
+	}
+	/* full-text index and fingerprint are stored in the same transaction */
+	html_text(&text, item_desc);
+	/* list pages show the summary of the long descriptions */
+	if (item_desc && strlen(item_desc) > HTML_SUMMARY_MIN)
+		html_summary(&summary, blob_str(&text), HTML_SUMMARY_LEN);
+	start = metrics_now();
+	/* savepoint, the merge replays items inside its own transaction */
+	db_multi_exec("SAVEPOINT add_feed");
+	db_prepare(&q, "INSERT INTO feeds (chanid, modified, link, title, "
+					"description, summary, pubdate, ingested, "
+					"duplicate) "
+			"VALUES (%d, 0, '%q', '%q', :desc, %Q, '%ld', %ld, "
+				"NULLIF(%ld, 0))",
+			 chan_id, item_url, item_title,
+			 blob_size(&summary) ? blob_str(&summary) : NULL,
+			 item_date, (long)time(NULL), duplicate);
+	if (zdesc_compress(&zdesc, item_desc) == 0)
+		db_bind_blob(&q, ":desc", &zdesc);
+	else	/* the same as '%q' */
+		db_bind_text(&q, ":desc", item_desc ? item_desc : "(NULL)");
+	db_step(&q);
+	db_finalize(&q);
+	id = (long)sqlite3_last_insert_rowid(g.db);
+	db_multi_exec("INSERT INTO feeds_fts (rowid, title, description) "
+			"VALUES (%ld, %Q, '%q')", id, item_title, blob_str(&text));
+	/* later copies point to the first one */
+	if (duplicate == 0)
+		simhash_store(id, item_hash);
+	db_multi_exec("RELEASE add_feed");
+	metrics_time(T_SQL_ADD_FEED, start);
+	blob_reset(&text);
+	blob_reset(&zdesc);
+	blob_reset(&summary);
 	printf("New feed has been added %s.\n", item_url);
 }
 
@@ -66,16 +110,31 @@ check_link(int chan_id, char *item_link, time_t item_pubdate)
 {
 	int result = 0;
 	time_t	date;
+	uint64_t start = metrics_now();
 
 	dmsg(0, "check_link");
 	result = db_int(0, "SELECT id FROM feeds WHERE pubdate = '%ld' "
+				"AND chanid = '%d' AND link = '%q' "
+			"UNION ALL "
+			"SELECT id FROM feeds_archive WHERE pubdate = '%ld' "
 				"AND chanid = '%d' AND link = '%q'",
+					 item_pubdate, chan_id, item_link,
 					 item_pubdate, chan_id, item_link);
+	/* items staged by the previous, not yet merged, runs of the shard */
+	if (result == 0 && shard_staging)
+		result = db_int(0, "SELECT id FROM stage.feeds "
+				"WHERE pubdate = %ld AND chanid = %d "
+				"AND link = '%q'",
+					 item_pubdate, chan_id, item_link);
+	metrics_time(T_SQL_CHECK_LINK, start);
 	if (result) {
 		dmsg(0, "record has been found.");
 		return (1); /* Don't do anything ;
 			     If you want to update changed post do it here */
 	}
+	/* the main database is not written by the shards */
+	if (shard_staging)
+		return (0);
 	/* update last modified  time of the channel */
 	db_multi_exec("UPDATE channels SET modified = '%ld' WHERE id = '%d'",
 	    time(&date), chan_id);
@@ -83,37 +142,113 @@ check_link(int chan_id, char *item_link, time_t item_pubdate)
 	return (0);
 }
 
-/* parse content of the rss */
-void
-parse_body(int chan_id, char *rssbody)
+/* store the new items of parsed feed, returns their number */
+int
+store_feed(int chan_id, struct feed *rss)
 {
-	struct feed *rss = NULL;
+	Blob clean = empty_blob;
 	struct item *item;
+	uint64_t hash, start;
+	int count = 0;
+	long seen;
 
-	dmsg(0,"parse_body.");
-
-	if ((rss = rss_parse(rssbody, 0)) == NULL) {
-		printf("rss id [%d] cannot be parsed.\n", chan_id);
-		return;
+	if (rss->truncated) {
+		printf("rss id [%d] truncated.\n", chan_id);
+		metrics_add(M_CHANNELS_TRUNCATED, 1);
 	}
+	/*
+	 * flag oversized channels and keep title, site and language for
+	 * index.cgi, the shards stage them for the merge
+	 */
+	if (shard_staging)
+		shard_channel(chan_id, rss);
+	else
+		db_multi_exec("UPDATE channels SET truncated = %d, "
+				"title = %Q, site = %Q, language = %Q "
+				"WHERE id = %d AND (truncated IS NOT %d "
+				"OR title IS NOT %Q OR site IS NOT %Q "
+				"OR language IS NOT %Q)",
+				rss->truncated, rss->title, rss->url,
+				rss->language, chan_id, rss->truncated,
+				rss->title, rss->url, rss->language);
 	TAILQ_FOREACH(item, &rss->items_list, entry) {
-		if (check_link(chan_id, item->url, item->date) == 0) {
-			add_feed(chan_id, item->url, item->title, item->desc,
-			    item->date);
+		metrics_add(M_ITEMS_PARSED, 1);
+		if (check_link(chan_id, item->url, item->date) != 0) {
+			metrics_add(M_ITEMS_DUPLICATE, 1);
+			continue;
+		}
+		/* untrusted html is stored sanitized */
+		if (item->desc) {
+			html_sanitize(&clean, item->desc);
+			item->desc = pool_strdup(rss->pool, blob_str(&clean));
+			blob_reset(&clean);
+		}
+		/* the same story posted under a different url */
+		hash = simhash(item->title, item->desc);
+		start = metrics_now();
+		/* the merge looks for the near duplicates of staged items */
+		seen = shard_staging ? 0 : simhash_seen(hash);
+		metrics_time(T_SQL_SIMHASH, start);
+		if (seen) {
+			printf("Near duplicate of %ld %s.\n", seen, item->url);
+			metrics_add(M_ITEMS_NEAR_DUPLICATE, 1);
 		}
+		add_feed(chan_id, item->url, item->title, item->desc,
+		    item->date, hash, seen);
+		metrics_add(M_ITEMS_NEW, 1);
+		count++;
 	}
 	rss_close(rss);
+	return (count);
 }
 
-/* fetch rss file */
-void
+/*
+ * parse content of the rss, returns number of the new items or -1 when
+ * the body is not a feed, error says why
+ */
+int
+parse_body(int chan_id, const char *rssbody, size_t len, int truncated,
+    const char **error)
+{
+	struct feed *rss = NULL;
+	uint64_t start = metrics_now();
+	int sniff;
+
+	dmsg(0,"parse_body.");
+
+	sniff = rss_sniff(rssbody, len);
+	metrics_sniff(sniff);
+	if (sniff == RSS_SNIFF_REJECT) {
+		printf("rss id [%d] is not a feed.\n", chan_id);
+		*error = "not a feed";
+		return (-1);
+	}
+	rss = rss_parse_buffer(rssbody, len, items_max, truncated);
+	metrics_time(T_PARSE, start);
+	if (rss == NULL) {
+		printf("rss id [%d] cannot be parsed.\n", chan_id);
+		metrics_add(M_PARSE_ERRORS, 1);
+		*error = "cannot be parsed";
+		return (-1);
+	}
+	/* the shards stage the hub in store_feed() */
+	if (!shard_staging)
+		websub_discover(chan_id, rss->hub, rss->self);
+	return (store_feed(chan_id, rss));
+}
+
+/* fetch rss file, returns number of the new items */
+int
 fetch_channel(int id, time_t modified, const char *link)
 {
     Blob body = empty_blob;
     struct url *url;
     struct url_stat us;
+    const char *error = NULL;
     char flags[8];
     FILE *fp;
+    int count = 0, rc;
+    uint64_t start;
 
     *flags = 0;
 
@@ -121,32 +256,83 @@ fetch_channel(int id, time_t modified, const char *link)
 
     if ((url = fetchParseURL(link)) == NULL) {
         dmsg(0, "%s: invalid URL %s", __func__, link);
-        return;
+        crawl_result(id, crawl_error(FETCH_URL), "invalid URL");
+        return (0);
     }
 
     url->ims_time = modified;
     strcat(flags, "i");
 
-    if ((fp = fetchXGet(url, &us, flags)) == NULL) {
+    metrics_add(M_CHANNELS, 1);
+    /* resolve, connect, request and response headers */
+    start = metrics_now();
+    fp = fetchXGet(url, &us, flags);
+    metrics_time(T_FETCH_CONNECT, start);
+    if (fp == NULL && fetchLastErrCode == FETCH_UNCHANGED) {
+        dmsg(0, "%s: not modified %s", __func__, link);
+        crawl_result(id, NULL, fetchLastErrString);
+        goto fail;
+    }
+    if (fp == NULL) {
         dmsg(0, "%s: cannot fetch URL %s", __func__, link);
+        metrics_add(M_CHANNELS_FAILED, 1);
+        crawl_result(id, crawl_error(fetchLastErrCode), fetchLastErrString);
         goto fail;
     }
-    if ((blob_read_from_channel(&body, fp, -1)) < 1) {
+    start = metrics_now();
+    rc = body_read(&body, fp, body_max);
+    fclose(fp);
+    metrics_time(T_FETCH_TRANSFER, start);
+    if (rc == -1) {
+        dmsg(0, "%s: broken compressed body %s", __func__, link);
+        metrics_add(M_CHANNELS_FAILED, 1);
+        crawl_result(id, "body", "broken compressed body");
+        goto reset;
+    }
+    if (blob_size(&body) < 1) {
         dmsg(0, "%s: empty body %s", __func__, link);
+        crawl_result(id, "body", "empty body");
         goto reset;
     }
-    parse_body(id, blob_str(&body));
+    record_body(id, link, us.mtime, rc == 1, &body);
+    count = parse_body(id, blob_buffer(&body), blob_size(&body), rc == 1,
+        &error);
+    if (count == -1) {
+        crawl_result(id, "feed", error);
+        count = 0;
+    } else {
+        crawl_result(id, NULL, "OK");
+    }
 reset:
     blob_reset(&body);
 fail:
     fetchFreeURL(url);
+    return (count);
 }
 
 static void
 usage(void)
 {
 	extern	char *__progname;
-	fprintf(stderr, "Usage: %s [-v] [-d database]\n", __progname);
+	fprintf(stderr, "Usage: %s [-Tv] [-d database] [-m metrics] "
+	    "[-o outdir [-n items] [-t htmldir]]\n"
+	    "              [-b kbytes] [-H callback] [-i items] [-R dir]\n"
+	    "              [-r resolvers] [-s k/N] [-w delay]\n"
+	    "       %s [-v] [-d database] [-m metrics] "
+	    "[-o outdir [-n items] [-t htmldir]]\n"
+	    "              [-i items] [-j threads] -P dir | -f dir|pattern\n"
+	    "       %s [-v] [-d database] [-m metrics] "
+	    "[-o outdir [-n items] [-t htmldir]]\n"
+	    "              -M staging ...\n"
+	    "       %s [-v] [-d database] [-o outdir [-n items] "
+	    "[-t htmldir]]\n"
+	    "              [-b kbytes] [-i items] -W [host:]port\n"
+	    "       %s [-v] [-d database] [-m metrics] "
+	    "[-o outdir [-n items] [-t htmldir]]\n"
+	    "              [-b kbytes] [-i items] [-j threads] -I opml\n"
+	    "       %s [-v] [-d database] -E opml\n",
+	    __progname, __progname, __progname, __progname, __progname,
+	    __progname);
 	exit(1);
 }
 
@@ -154,23 +340,103 @@ int
 main(int argc, char** argv)
 {
 
-	int ch;
+	int ch, items = 20, train = 0, merge = 0;
+	int shard = -1, shards = 1, delay = 0, resolvers = 0, jobs;
+	int backoff = 0;
+	long kbytes;
 	const char *dbname = "/var/db/rssroll.db";
+	const char *htmldir = "/opt/rssroll/html";
+	const char *outdir = NULL;
+	const char *metrics = NULL;
+	const char *replay = NULL;
+	const char *ingest = NULL;
+	const char *push = NULL;
+	const char *import = NULL;
+	const char *export = NULL;
+	uint64_t start = metrics_now();
 	Stmt q;
 
-	while ((ch = getopt(argc, argv, "d:v")) != -1) {
+	if ((jobs = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+		jobs = 1;
+	while ((ch = getopt(argc, argv, "E:H:I:MP:R:TW:b:d:f:i:j:m:n:o:r:s:t:vw:")) != -1) {
 		switch (ch) {
+			case 'E':
+				export = optarg;
+				break;
+			case 'H':
+				websub_open(optarg);
+				break;
+			case 'I':
+				import = optarg;
+				break;
+			case 'M':
+				merge = 1;
+				break;
+			case 'P':
+				replay = optarg;
+				break;
+			case 'R':
+				record_open(optarg);
+				break;
+			case 'T':
+				train = 1;
+				break;
+			case 'W':
+				push = optarg;
+				break;
+			case 'b':
+				if ((kbytes = strtol(optarg, NULL, 10)) <= 0)
+					usage();
+				body_max = (size_t)kbytes * 1024;
+				break;
 			case 'd':
 				dbname = optarg;
 				break;
+			case 'f':
+				ingest = optarg;
+				break;
+			case 'i':
+				if ((items_max = strtol(optarg, NULL, 10)) < 0)
+					usage();
+				break;
+			case 'j':
+				if ((jobs = strtol(optarg, NULL, 10)) <= 0)
+					usage();
+				break;
+			case 'm':
+				metrics = optarg;
+				break;
+			case 'n':
+				if ((items = strtol(optarg, NULL, 10)) <= 0)
+					usage();
+				break;
+			case 'o':
+				outdir = optarg;
+				break;
+			case 'r':
+				if ((resolvers = strtol(optarg, NULL, 10)) < 0)
+					usage();
+				break;
+			case 's':
+				if (shard_parse(optarg, &shard, &shards) == -1)
+					usage();
+				break;
+			case 't':
+				htmldir = optarg;
+				break;
 			case 'v':
 				debug++;
 				break;
+			case 'w':
+				if ((delay = strtol(optarg, NULL, 10)) < 0)
+					usage();
+				break;
 			default:
 				usage();
 		}
 	}
-	if (argc != optind) {
+	if ((merge && (argc == optind || shard != -1)) ||
+	    (!merge && argc != optind)) {
 		usage();
 	}
 	if (access(dbname, R_OK)) {
@@ -181,13 +447,82 @@ main(int argc, char** argv)
 		fprintf(stderr, "Cannot open database file: %s\n", dbname);
 		return (1);
 	}
+	/* the push receiver and the crawler may write at the same time */
+	sqlite3_busy_timeout(g.db, 10000);
 	dmsg(0, "database successfully loaded.");
-	db_prepare(&q, "SELECT id, modified, link FROM channels");
+	if (train) {
+		zdesc_train();
+		goto done;
+	}
+	zdesc_init();
+	if (merge) {
+		for (; optind < argc; optind++)
+			shard_merge(argv[optind]);
+		websub_subscribe();
+		goto store;
+	}
+	if (replay) {
+		replay_run(replay, jobs, body_max, items_max);
+		goto store;
+	}
+	if (ingest) {
+		ingest_run(ingest, jobs, items_max);
+		goto store;
+	}
+	if (import) {
+		opml_import(import, jobs, body_max, items_max);
+		goto store;
+	}
+	if (export) {
+		opml_export(export);
+		goto done;
+	}
+	if (push)
+		websub_serve(push, body_max, items_max, htmldir, outdir, items);
+	if (shard != -1)
+		shard_open(dbname, shard);
+	/*
+	 * channels pushed by a hub are not polled, failing channels wait for
+	 * their retry, the shard has the newer one until the merge
+	 */
+	db_prepare(&q, "SELECT id, modified, link, tagid, %s > %ld "
+			"FROM channels "
+			"WHERE id %% %d = %d AND id NOT IN (SELECT chanid "
+				"FROM subscriptions WHERE expires > %ld)",
+			shard_staging ? "COALESCE((SELECT retry FROM "
+			    "stage.health WHERE chanid = channels.id), retry)" :
+			    "retry", (long)time(NULL),
+			shards, shard == -1 ? 0 : shard, (long)time(NULL));
 	while (db_step(&q)==SQLITE_ROW) {
-		fetch_channel(db_column_int(&q, 0), (time_t)db_column_int64(&q, 1),
-		    db_column_text(&q, 2));
+		if (db_column_int(&q, 4)) {
+			dmsg(0, "backoff: %s", db_column_text(&q, 2));
+			backoff++;
+			continue;
+		}
+		crawl_add(db_column_int(&q, 0), (time_t)db_column_int64(&q, 1),
+		    db_column_text(&q, 2), db_column_int64(&q, 3));
 	}
 	db_finalize(&q);
+	if (backoff) {
+		printf("%d failing channels wait for retry.\n", backoff);
+		metrics_add(M_CHANNELS_BACKOFF, backoff);
+	}
+	crawl_resolve(resolvers);
+	crawl_run(delay);
+	/* the rest is done by the merge */
+	if (shard != -1)
+		goto stats;
+	websub_subscribe();
+store:
+	retention_run();
+	if (outdir)
+		summary_update(htmldir, outdir, items);
+stats:
+	record_close();
+	metrics_time(T_RUN, start);
+	if (metrics)
+		metrics_write(metrics);
+done:
 	sqlite3_close(g.db);
 	dmsg(0, "database successfully closed.");
 	return (0);
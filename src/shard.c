@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2026 Nikola Kolev <koue@chaosophia.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Sharded crawling.
+ *
+ * With -s k/N the crawler fetches only the channels with id % N = k.
+ * The main database is only read, the new items are written into the
+ * staging database <database>.shard<k>, attached as "stage". Any number
+ * of shards can run at the same time, on the same host or on hosts with
+ * a copy of the main database.
+ *
+ * The merge (-M) replays the staged items through the usual store path
+ * (duplicate and near duplicate checks, compression, full-text index)
+ * in a single transaction, copies the channel metadata, hub discovery
+ * and failure state of the channels and empties the staging database. The transaction takes its write locks
+ * up front, a staging database still locked after the busy timeout is
+ * left for the next merge.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fslbase.h>
+#include <fsldb.h>
+#include <sqlite3.h>
+
+#include "rss.h"
+
+int shard_staging = 0;
+
+/* parse k/N */
+int
+shard_parse(const char *arg, int *k, int *n)
+{
+	char *end;
+
+	*k = strtol(arg, &end, 10);
+	if (end == arg || *end != '/')
+		return (-1);
+	arg = end + 1;
+	*n = strtol(arg, &end, 10);
+	if (end == arg || *end != 0 || *n < 1 || *k < 0 || *k >= *n)
+		return (-1);
+	return (0);
+}
+
+static void
+shard_tables(void)
+{
+	db_multi_exec("CREATE TABLE IF NOT EXISTS stage.feeds ("
+			"id INTEGER PRIMARY KEY AUTOINCREMENT, "
+			"chanid INTEGER, "
+			"link TEXT, "
+			"title TEXT, "
+			"description TEXT, "
+			"pubdate INTEGER, "
+			"hash INTEGER)");
+	db_multi_exec("CREATE TABLE IF NOT EXISTS stage.channels ("
+			"chanid INTEGER PRIMARY KEY, "
+			"truncated INTEGER, "
+			"title TEXT, "
+			"site TEXT, "
+			"language TEXT, "
+			"hub TEXT, "
+			"topic TEXT)");
+	db_multi_exec("CREATE TABLE IF NOT EXISTS stage.health ("
+			"chanid INTEGER PRIMARY KEY, "
+			"failures INTEGER, "
+			"error TEXT, "
+			"status TEXT, "
+			"retry INTEGER)");
+}
+
+/* attach staging database of shard k, the new items go there */
+void
+shard_open(const char *dbname, int k)
+{
+	char *path = mprintf("%s.shard%d", dbname, k);
+
+	dmsg(0, "%s: %s", __func__, path);
+	db_multi_exec("ATTACH DATABASE '%q' AS stage", path);
+	shard_tables();
+	shard_staging = 1;
+	fossil_free(path);
+}
+
+/* stage new item, sanitized, as add_feed() would get it */
+void
+shard_store(int chan_id, const char *url, const char *title,
+    const char *desc, time_t date, uint64_t hash)
+{
+	db_multi_exec("INSERT INTO stage.feeds (chanid, link, title, "
+			"description, pubdate, hash) "
+			"VALUES (%d, %Q, %Q, %Q, %ld, %lld)",
+			chan_id, url, title, desc, (long)date, (long long)hash);
+}
+
+/* stage channel metadata and hub of parsed feed, see store_feed() */
+void
+shard_channel(int chan_id, struct feed *rss)
+{
+	db_multi_exec("INSERT OR REPLACE INTO stage.channels (chanid, "
+			"truncated, title, site, language, hub, topic) "
+			"VALUES (%d, %d, %Q, %Q, %Q, %Q, %Q)",
+			chan_id, rss->truncated, rss->title, rss->url,
+			rss->language, rss->hub, rss->self);
+}
+
+/* replay staged items of path into the main database, -1 when locked */
+int
+shard_merge(const char *path)
+{
+	uint64_t hash;
+	long seen;
+	char *sql;
+	int rc, count = 0;
+	Stmt q;
+
+	dmsg(0, "%s: %s", __func__, path);
+	/* a shard still writing holds the lock, skip it until the next merge */
+	sql = mprintf("ATTACH DATABASE '%q' AS stage", path);
+	rc = sqlite3_exec(g.db, sql, NULL, NULL, NULL);
+	fossil_free(sql);
+	/* a deferred BEGIN would fail on the lock upgrade, without waiting */
+	if (rc != SQLITE_OK ||
+	    sqlite3_exec(g.db, "BEGIN IMMEDIATE", NULL, NULL, NULL) !=
+	    SQLITE_OK) {
+		fprintf(stderr, "%s: %s: %s, skipped\n", __func__, path,
+		    sqlite3_errmsg(g.db));
+		if (rc == SQLITE_OK)
+			db_multi_exec("DETACH DATABASE stage");
+		return (-1);
+	}
+	shard_tables();
+	db_prepare(&q, "SELECT s.chanid, s.link, s.title, s.description, "
+			"s.pubdate, s.hash, c.tagid "
+			"FROM stage.feeds AS s "
+			"JOIN channels AS c ON c.id = s.chanid "
+			"ORDER BY s.id");
+	while (db_step(&q) == SQLITE_ROW) {
+		if (check_link(db_column_int(&q, 0),
+		    (char *)db_column_text(&q, 1),
+		    (time_t)db_column_int64(&q, 4)) != 0) {
+			metrics_add(M_ITEMS_DUPLICATE, 1);
+			continue;
+		}
+		/* shards do not see each other */
+		hash = (uint64_t)db_column_int64(&q, 5);
+		if ((seen = simhash_seen(hash)) != 0) {
+			printf("Near duplicate of %ld %s.\n", seen,
+			    db_column_text(&q, 1));
+			metrics_add(M_ITEMS_NEAR_DUPLICATE, 1);
+		}
+		add_feed(db_column_int(&q, 0), (char *)db_column_text(&q, 1),
+		    (char *)db_column_text(&q, 2),
+		    (char *)db_column_text(&q, 3),
+		    (time_t)db_column_int64(&q, 4), hash, seen);
+		metrics_add(M_ITEMS_NEW, 1);
+		summary_mark(db_column_int64(&q, 6));
+		count++;
+	}
+	db_finalize(&q);
+	/* title, site, language and truncated flag of the parsed channels */
+	db_multi_exec("UPDATE channels SET (truncated, title, site, language) "
+			"= (SELECT truncated, title, site, language "
+			"FROM stage.channels WHERE chanid = channels.id) "
+			"WHERE id IN (SELECT chanid FROM stage.channels)");
+	db_prepare(&q, "SELECT chanid, hub, topic FROM stage.channels "
+			"WHERE hub IS NOT NULL");
+	while (db_step(&q) == SQLITE_ROW)
+		websub_discover(db_column_int(&q, 0),
+		    (char *)db_column_text(&q, 1),
+		    (char *)db_column_text(&q, 2));
+	db_finalize(&q);
+	/* failure state of the fetched channels, see crawl_result() */
+	db_multi_exec("UPDATE channels SET (failures, error, status, retry) = "
+			"(SELECT failures, error, status, retry "
+			"FROM stage.health WHERE chanid = channels.id) "
+			"WHERE id IN (SELECT chanid FROM stage.health)");
+	db_multi_exec("DELETE FROM stage.health");
+	db_multi_exec("DELETE FROM stage.channels");
+	db_multi_exec("DELETE FROM stage.feeds");
+	db_multi_exec("COMMIT");
+	db_multi_exec("DETACH DATABASE stage");
+	printf("%d items merged from %s.\n", count, path);
+	return (count);
+}
@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2026 Nikola Kolev <koue@chaosophia.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/*
+ * SimHash fingerprints of the items.
+ *
+ * Every word of the normalized (markup stripped, lower case) title and
+ * description votes for the bits of its 64-bit hash. Near duplicate texts
+ * end up with fingerprints which differ in a few bits only.
+ *
+ * The fingerprint is split into SIMHASH_BANDS bands stored in indexed
+ * columns. Two fingerprints within SIMHASH_DISTANCE bits share at least
+ * one whole band, so the lookup reads only the rows of the matching
+ * buckets instead of scanning the archive.
+ *
+ * A near duplicate is stored with the id of the first item in
+ * feeds.duplicate and gets no fingerprint of its own. The pages of a tag
+ * and the search results hide it when they show the first item too, the
+ * page of its own channel shows it.
+ */
+
+#include <ctype.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <fslbase.h>
+#include <fsldb.h>
+#include <sqlite3.h>
+
+#include "rss.h"
+
+#define	SIMHASH_BANDS		4
+#define	SIMHASH_DISTANCE	3
+#define	SIMHASH_MINWORDS	16
+#define	SIMHASH_WINDOW		(7 * 24 * 60 * 60)
+
+static void
+simhash_words(int *vote, int *words, const char *text)
+{
+	const unsigned char *p = (const unsigned char *)text;
+	uint64_t hash;
+	int i;
+
+	while (p && *p) {
+		if (!isalnum(*p) && *p < 0x80) {
+			p++;
+			continue;
+		}
+		/* FNV-1a */
+		hash = 0xcbf29ce484222325ULL;
+		while (*p && (isalnum(*p) || *p >= 0x80)) {
+			hash ^= tolower(*p++);
+			hash *= 0x100000001b3ULL;
+		}
+		for (i = 0; i < 64; i++)
+			vote[i] += ((hash >> i) & 1) ? 1 : -1;
+		(*words)++;
+	}
+}
+
+/* returns 0 if the text is too short to be fingerprinted */
+uint64_t
+simhash(const char *title, const char *desc)
+{
+	Blob text = empty_blob;
+	uint64_t hash = 0;
+	int vote[64], words = 0, i;
+
+	memset(vote, 0, sizeof(vote));
+	html_text(&text, desc);
+	simhash_words(vote, &words, title);
+	simhash_words(vote, &words, blob_str(&text));
+	blob_reset(&text);
+	if (words < SIMHASH_MINWORDS)
+		return (0);
+	for (i = 0; i < 64; i++) {
+		if (vote[i] > 0)
+			hash |= (1ULL << i);
+	}
+	return (hash);
+}
+
+static int
+simhash_distance(uint64_t a, uint64_t b)
+{
+	uint64_t x = a ^ b;
+	int count = 0;
+
+	for (; x; count++)
+		x &= x - 1;
+	return (count);
+}
+
+#define	BAND(hash, n)	((long)(((hash) >> ((n) * 16)) & 0xffff))
+
+/* id of a near duplicate stored recently, 0 when there is none */
+long
+simhash_seen(uint64_t hash)
+{
+	Stmt q;
+	long found = 0;
+
+	if (hash == 0)
+		return (0);
+	db_prepare(&q, "SELECT feedid, hash FROM feeds_simhash "
+			"WHERE (band0 = %ld OR band1 = %ld OR "
+			"band2 = %ld OR band3 = %ld) AND created > %ld",
+			BAND(hash, 0), BAND(hash, 1), BAND(hash, 2),
+			BAND(hash, 3), (long)time(NULL) - SIMHASH_WINDOW);
+	while (db_step(&q) == SQLITE_ROW) {
+		if (simhash_distance(hash,
+		    (uint64_t)db_column_int64(&q, 1)) <= SIMHASH_DISTANCE) {
+			found = (long)db_column_int64(&q, 0);
+			dmsg(0, "%s: near duplicate of %ld", __func__, found);
+			break;
+		}
+	}
+	db_finalize(&q);
+	return (found);
+}
+
+/* store fingerprint of the item */
+void
+simhash_store(long feedid, uint64_t hash)
+{
+	if (hash == 0)
+		return;
+	db_multi_exec("INSERT INTO feeds_simhash (feedid, created, hash, "
+			"band0, band1, band2, band3) "
+			"VALUES (%ld, %ld, %lld, %ld, %ld, %ld, %ld)",
+			feedid, (long)time(NULL), (long long)hash,
+			BAND(hash, 0), BAND(hash, 1), BAND(hash, 2),
+			BAND(hash, 3));
+}
@@ -0,0 +1,311 @@
+/*
+ * Copyright (c) 2026 Nikola Kolev <koue@chaosophia.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Per-tag summary feeds.
+ *
+ * The crawler marks every tag which received new items during the run.
+ * At the end of the run only the marked tags (and tags without output
+ * file yet) are regenerated from html/summary.rss and
+ * html/summary_item.rss. Each file holds the newest items of the tag and
+ * is replaced atomically, so its mtime and size change only when there is
+ * something new. The web server serves the files as static content and
+ * answers conditional requests (ETag/Last-Modified) from them, the
+ * subscribers never reach the database.
+ */
+
+#include <sys/stat.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <fslbase.h>
+#include <fsldb.h>
+#include <sqlite3.h>
+
+#include "rss.h"
+
+struct summary_tag {
+	long id;
+	TAILQ_ENTRY(summary_tag) entry;
+};
+
+static TAILQ_HEAD(, summary_tag) summary_list =
+    TAILQ_HEAD_INITIALIZER(summary_list);
+
+struct summary_item {
+	const char *title;
+	const char *link;
+	const char *desc;
+	time_t date;
+};
+
+/* mark tag for regeneration */
+void
+summary_mark(long tagid)
+{
+	struct summary_tag *tag;
+
+	TAILQ_FOREACH(tag, &summary_list, entry) {
+		if (tag->id == tagid)
+			return;
+	}
+	if ((tag = malloc(sizeof(struct summary_tag))) == NULL) {
+		fprintf(stderr, "%s: %s\n", __func__, strerror(errno));
+		exit(1);
+	}
+	tag->id = tagid;
+	TAILQ_INSERT_TAIL(&summary_list, tag, entry);
+}
+
+static int
+summary_marked(long tagid)
+{
+	struct summary_tag *tag;
+
+	TAILQ_FOREACH(tag, &summary_list, entry) {
+		if (tag->id == tagid)
+			return (1);
+	}
+	return (0);
+}
+
+static int
+summary_load(Blob *tmpl, const char *htmldir, const char *name)
+{
+	char fn[256];
+	FILE *fp;
+
+	snprintf(fn, sizeof(fn), "%s/%s", htmldir, name);
+	if ((fp = fopen(fn, "r")) == NULL) {
+		fprintf(stderr, "%s: %s: %s\n", __func__, fn, strerror(errno));
+		return (-1);
+	}
+	blob_read_from_channel(tmpl, fp, -1);
+	fclose(fp);
+	return (0);
+}
+
+static void
+summary_escape(FILE *out, const char *s)
+{
+	for (; s && *s; s++) {
+		switch (*s) {
+		case '<':
+			fputs("&lt;", out);
+			break;
+		case '>':
+			fputs("&gt;", out);
+			break;
+		case '&':
+			fputs("&amp;", out);
+			break;
+		case '"':
+			fputs("&quot;", out);
+			break;
+		default:
+			fputc(*s, out);
+		}
+	}
+}
+
+/* CDATA section cannot contain its own terminator */
+static void
+summary_cdata(FILE *out, const char *s)
+{
+	const char *p;
+
+	while (s && (p = strstr(s, "]]>")) != NULL) {
+		fwrite(s, 1, p - s, out);
+		fputs("]]]]><![CDATA[>", out);
+		s = p + 3;
+	}
+	if (s)
+		fputs(s, out);
+}
+
+/*
+ * Copy template into out and call macro() for every %%NAME%% found.
+ * Unknown macros are printed as they are.
+ */
+static void
+summary_expand(FILE *out, const char *tmpl,
+    int (*macro)(FILE *, const char *, void *), void *arg)
+{
+	const char *p, *end;
+	char name[32];
+
+	while ((p = strstr(tmpl, "%%")) != NULL) {
+		fwrite(tmpl, 1, p - tmpl, out);
+		if (((end = strstr(p + 2, "%%")) == NULL) ||
+		    ((end - p - 2) >= (int)sizeof(name))) {
+			fputs("%%", out);
+			tmpl = p + 2;
+			continue;
+		}
+		memcpy(name, p + 2, end - p - 2);
+		name[end - p - 2] = 0;
+		if (macro(out, name, arg) == -1)
+			fwrite(p, 1, end - p + 2, out);
+		tmpl = end + 2;
+	}
+	fputs(tmpl, out);
+}
+
+static int
+summary_item_macro(FILE *out, const char *macro, void *arg)
+{
+	struct summary_item *item = (struct summary_item *)arg;
+	char date[64];
+
+	if (strcmp(macro, "TITLE") == 0) {
+		summary_escape(out, item->title);
+	} else if (strcmp(macro, "LINK") == 0) {
+		summary_escape(out, item->link);
+	} else if (strcmp(macro, "DATE") == 0) {
+		if (item->date) {
+			strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT",
+			    gmtime(&item->date));
+			fputs(date, out);
+		}
+	} else if (strcmp(macro, "BODY") == 0) {
+		summary_cdata(out, item->desc);
+	} else {
+		return (-1);
+	}
+	return (0);
+}
+
+struct summary_feed {
+	long tagid;
+	const char *title;
+	const char *item;
+	int count;
+};
+
+static int
+summary_feed_macro(FILE *out, const char *macro, void *arg)
+{
+	struct summary_feed *feed = (struct summary_feed *)arg;
+	struct summary_item item;
+	Blob desc = empty_blob;
+	Stmt q;
+
+	if (strcmp(macro, "TAG") == 0) {
+		summary_escape(out, feed->title);
+	} else if (strcmp(macro, "ITEMS") == 0) {
+		db_prepare(&q, "SELECT link, title, description, pubdate "
+				"FROM feeds AS f "
+				"WHERE chanid IN (SELECT id FROM channels "
+				"WHERE tagid = '%ld') "
+				"AND (duplicate IS NULL OR NOT EXISTS "
+				"(SELECT 1 FROM feeds AS o "
+				"JOIN channels AS oc ON oc.id = o.chanid "
+				"WHERE o.id = f.duplicate AND oc.tagid = '%ld')) "
+				"ORDER BY id DESC LIMIT %d",
+				feed->tagid, feed->tagid, feed->count);
+		while (db_step(&q) == SQLITE_ROW) {
+			item.link = db_column_text(&q, 0);
+			item.title = db_column_text(&q, 1);
+			zdesc_column(&q, 2, &desc);
+			item.desc = blob_str(&desc);
+			item.date = (time_t)db_column_int64(&q, 3);
+			summary_expand(out, feed->item, summary_item_macro,
+			    &item);
+			blob_reset(&desc);
+		}
+		db_finalize(&q);
+	} else {
+		return (-1);
+	}
+	return (0);
+}
+
+static int
+summary_write(const char *outdir, struct summary_feed *feed, const char *tmpl)
+{
+	char fn[256], tmp[256];
+	FILE *out;
+
+	snprintf(fn, sizeof(fn), "%s/%ld.rss", outdir, feed->tagid);
+	snprintf(tmp, sizeof(tmp), "%s/.%ld.rss.tmp", outdir, feed->tagid);
+	dmsg(0, "%s: %s", __func__, fn);
+	if ((out = fopen(tmp, "w")) == NULL) {
+		fprintf(stderr, "%s: %s: %s\n", __func__, tmp, strerror(errno));
+		return (-1);
+	}
+	summary_expand(out, tmpl, summary_feed_macro, feed);
+	if (fclose(out) != 0 || rename(tmp, fn) != 0) {
+		fprintf(stderr, "%s: %s: %s\n", __func__, fn, strerror(errno));
+		unlink(tmp);
+		return (-1);
+	}
+	return (0);
+}
+
+/* regenerate summary feeds of the marked tags */
+void
+summary_update(const char *htmldir, const char *outdir, int count)
+{
+	Blob head = empty_blob, item = empty_blob;
+	struct summary_feed feed;
+	struct summary_tag *tag;
+	struct stat st;
+	char fn[256];
+	Stmt q;
+
+	dmsg(0, "%s: start", __func__);
+	if ((summary_load(&head, htmldir, "summary.rss") == -1) ||
+	    (summary_load(&item, htmldir, "summary_item.rss") == -1))
+		goto done;
+
+	feed.item = blob_str(&item);
+	feed.count = count;
+	db_prepare(&q, "SELECT id, title FROM tags ORDER BY id");
+	while (db_step(&q) == SQLITE_ROW) {
+		feed.tagid = db_column_int64(&q, 0);
+		feed.title = db_column_text(&q, 1);
+		snprintf(fn, sizeof(fn), "%s/%ld.rss", outdir, feed.tagid);
+		if (summary_marked(feed.tagid) || stat(fn, &st) == -1)
+			summary_write(outdir, &feed, blob_str(&head));
+	}
+	db_finalize(&q);
+done:
+	while ((tag = TAILQ_FIRST(&summary_list)) != NULL) {
+		TAILQ_REMOVE(&summary_list, tag, entry);
+		free(tag);
+	}
+	blob_reset(&head);
+	blob_reset(&item);
+	dmsg(0, "%s: end", __func__);
+}
@@ -0,0 +1,556 @@
+/*
+ * Copyright (c) 2026 Nikola Kolev <koue@chaosophia.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * WebSub (PubSubHubbub) subscriptions.
+ *
+ * With a callback URL (-H) the crawler remembers the hub advertised by a
+ * feed, <link rel="hub">, and after the crawl asks the hubs to subscribe
+ * the channels whose subscription is missing or about to expire. The
+ * callback of a channel is the callback URL followed by /<channel id>.
+ *
+ * The receiver (-W) is a small HTTP server, normally run behind the web
+ * server. It answers the verification of the hub (GET with hub.mode and
+ * hub.challenge) and takes the content distribution (POST of the feed),
+ * checked against the secret of the subscription, through the usual store
+ * path. Channels with a verified subscription are not polled until it
+ * expires.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <errno.h>
+#include <netdb.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <fetch.h>
+#include <sha.h>
+#include <sha256.h>
+
+#include <fslbase.h>
+#include <fsldb.h>
+#include <sqlite3.h>
+
+#include "rss.h"
+
+#define WEBSUB_LEASE	(10 * 86400)	/* requested lease */
+#define WEBSUB_RENEW	86400		/* renew before the lease expires */
+#define WEBSUB_RETRY	3600		/* between unanswered requests */
+#define WEBSUB_TIMEOUT	10		/* receiver socket timeout */
+
+static const char *websub_callback = NULL;
+
+/* subscribe the channels with hub, callback/<channel id> is theirs */
+void
+websub_open(const char *callback)
+{
+	websub_callback = callback;
+}
+
+/* remember the hub of the channel, topic defaults to the channel link */
+void
+websub_discover(int chanid, const char *hub, const char *topic)
+{
+	if (websub_callback == NULL || hub == NULL)
+		return;
+	dmsg(0, "%s: %d: %s", __func__, chanid, hub);
+	/* a new hub or topic needs a new subscription */
+	db_multi_exec("INSERT INTO subscriptions (chanid, hub, topic, "
+				"requested, expires) "
+			"VALUES (%d, '%q', COALESCE(%Q, (SELECT link "
+				"FROM channels WHERE id = %d)), 0, 0) "
+			"ON CONFLICT (chanid) DO UPDATE "
+				"SET hub = excluded.hub, "
+				"topic = excluded.topic, secret = NULL, "
+				"requested = 0, expires = 0 "
+			"WHERE hub IS NOT excluded.hub "
+				"OR topic IS NOT excluded.topic",
+			chanid, hub, topic, chanid);
+}
+
+/* application/x-www-form-urlencoded */
+static void
+websub_encode(Blob *out, const char *s)
+{
+	static const char hex[] = "0123456789ABCDEF";
+
+	for (; *s; s++) {
+		if ((*s >= 'a' && *s <= 'z') || (*s >= 'A' && *s <= 'Z') ||
+		    (*s >= '0' && *s <= '9') || strchr("-._~", *s) != NULL) {
+			blob_append(out, s, 1);
+		} else {
+			blob_append(out, "%", 1);
+			blob_append(out, &hex[(unsigned char)*s >> 4], 1);
+			blob_append(out, &hex[*s & 0x0f], 1);
+		}
+	}
+}
+
+static void
+websub_request(int chanid, const char *hub, const char *topic,
+    const char *secret)
+{
+	Blob body = empty_blob;
+	struct url *url;
+	char buf[64];
+	FILE *fp;
+
+	dmsg(0, "%s: %d: %s", __func__, chanid, hub);
+	if ((url = fetchParseURL(hub)) == NULL) {
+		fprintf(stderr, "%s: invalid hub %s\n", __func__, hub);
+		return;
+	}
+	blob_append(&body, "hub.mode=subscribe&hub.topic=", -1);
+	websub_encode(&body, topic);
+	blob_append(&body, "&hub.callback=", -1);
+	snprintf(buf, sizeof(buf), "/%d", chanid);
+	websub_encode(&body, websub_callback);
+	websub_encode(&body, buf);
+	blob_append(&body, "&hub.secret=", -1);
+	blob_append(&body, secret, -1);
+	snprintf(buf, sizeof(buf), "&hub.lease_seconds=%d", WEBSUB_LEASE);
+	blob_append(&body, buf, -1);
+	/* the hub answers 202 and verifies the callback on its own */
+	if ((fp = fetchReqHTTP(url, "POST", "",
+	    "application/x-www-form-urlencoded", blob_str(&body))) == NULL) {
+		fprintf(stderr, "%s: %s: %s\n", __func__, hub,
+		    fetchLastErrString);
+	} else {
+		printf("Subscription of channel %d requested from %s.\n",
+		    chanid, hub);
+		fclose(fp);
+	}
+	fetchFreeURL(url);
+	blob_reset(&body);
+}
+
+/* request new and expiring subscriptions */
+void
+websub_subscribe(void)
+{
+	unsigned char raw[20];
+	char secret[2 * sizeof(raw) + 1];
+	time_t now = time(NULL);
+	size_t i;
+	Stmt q;
+
+	if (websub_callback == NULL)
+		return;
+	dmsg(0, "%s: start", __func__);
+	db_prepare(&q, "SELECT chanid, hub, topic, secret FROM subscriptions "
+			"WHERE expires < %ld AND requested < %ld",
+			(long)(now + WEBSUB_RENEW), (long)(now - WEBSUB_RETRY));
+	while (db_step(&q) == SQLITE_ROW) {
+		if (db_column_text(&q, 3) == NULL) {
+			arc4random_buf(raw, sizeof(raw));
+			for (i = 0; i < sizeof(raw); i++)
+				snprintf(secret + 2 * i, 3, "%02x", raw[i]);
+		} else {
+			snprintf(secret, sizeof(secret), "%s",
+			    db_column_text(&q, 3));
+		}
+		websub_request(db_column_int(&q, 0), db_column_text(&q, 1),
+		    db_column_text(&q, 2), secret);
+		db_multi_exec("UPDATE subscriptions SET secret = '%q', "
+				"requested = %ld WHERE chanid = %d",
+				secret, (long)now, db_column_int(&q, 0));
+	}
+	db_finalize(&q);
+	dmsg(0, "%s: end", __func__);
+}
+
+/*
+ * HMAC (RFC 2104) of the pushed body, X-Hub-Signature is method=hex.
+ */
+union websub_ctx {
+	SHA_CTX sha1;
+	SHA256_CTX sha256;
+};
+
+struct websub_md {
+	const char *name;
+	size_t len;
+	void (*init)(union websub_ctx *);
+	void (*update)(union websub_ctx *, const void *, size_t);
+	void (*final)(unsigned char *, union websub_ctx *);
+};
+
+static void
+websub_sha1_init(union websub_ctx *ctx)
+{
+	SHA1_Init(&ctx->sha1);
+}
+
+static void
+websub_sha1_update(union websub_ctx *ctx, const void *data, size_t len)
+{
+	SHA1_Update(&ctx->sha1, data, len);
+}
+
+static void
+websub_sha1_final(unsigned char *md, union websub_ctx *ctx)
+{
+	SHA1_Final(md, &ctx->sha1);
+}
+
+static void
+websub_sha256_init(union websub_ctx *ctx)
+{
+	SHA256_Init(&ctx->sha256);
+}
+
+static void
+websub_sha256_update(union websub_ctx *ctx, const void *data, size_t len)
+{
+	SHA256_Update(&ctx->sha256, data, len);
+}
+
+static void
+websub_sha256_final(unsigned char *md, union websub_ctx *ctx)
+{
+	SHA256_Final(md, &ctx->sha256);
+}
+
+static const struct websub_md websub_mds[] = {
+	{ "sha1", 20, websub_sha1_init, websub_sha1_update,
+	    websub_sha1_final },
+	{ "sha256", 32, websub_sha256_init, websub_sha256_update,
+	    websub_sha256_final },
+	{ NULL, 0, NULL, NULL, NULL }
+};
+
+#define WEBSUB_BLOCK	64
+
+static int
+websub_verify(const char *secret, const char *signature, const char *body,
+    size_t len)
+{
+	const struct websub_md *md;
+	unsigned char key[WEBSUB_BLOCK], pad[WEBSUB_BLOCK], mac[32];
+	union websub_ctx ctx;
+	const char *hex;
+	unsigned int byte;
+	size_t i, keylen = strlen(secret);
+	int diff = 0;
+
+	if (signature == NULL || (hex = strchr(signature, '=')) == NULL)
+		return (-1);
+	for (md = websub_mds; md->name; md++) {
+		if (strlen(md->name) == (size_t)(hex - signature) &&
+		    strncasecmp(md->name, signature, hex - signature) == 0)
+			break;
+	}
+	if (md->name == NULL || strlen(++hex) != 2 * md->len)
+		return (-1);
+	memset(key, 0, sizeof(key));
+	if (keylen > sizeof(key)) {
+		md->init(&ctx);
+		md->update(&ctx, secret, keylen);
+		md->final(key, &ctx);
+	} else
+		memcpy(key, secret, keylen);
+	for (i = 0; i < sizeof(pad); i++)
+		pad[i] = key[i] ^ 0x36;
+	md->init(&ctx);
+	md->update(&ctx, pad, sizeof(pad));
+	md->update(&ctx, body, len);
+	md->final(mac, &ctx);
+	for (i = 0; i < sizeof(pad); i++)
+		pad[i] = key[i] ^ 0x5c;
+	md->init(&ctx);
+	md->update(&ctx, pad, sizeof(pad));
+	md->update(&ctx, mac, md->len);
+	md->final(mac, &ctx);
+	/* compare all of it, the time does not tell where it differs */
+	for (i = 0; i < md->len; i++) {
+		if (sscanf(hex + 2 * i, "%2x", &byte) != 1)
+			return (-1);
+		diff |= mac[i] ^ byte;
+	}
+	return (diff ? -1 : 0);
+}
+
+/* value of the query parameter name, url decoded */
+static int
+websub_param(Blob *out, const char *query, const char *name)
+{
+	size_t len = strlen(name);
+	unsigned int c;
+	const char *p;
+	char ch;
+
+	for (p = query; p; p = strchr(p, '&') ? strchr(p, '&') + 1 : NULL) {
+		if (strncmp(p, name, len) != 0 || p[len] != '=')
+			continue;
+		for (p += len + 1; *p && *p != '&'; p++) {
+			if (*p == '+') {
+				blob_append(out, " ", 1);
+			} else if (*p == '%' && sscanf(p + 1, "%2x", &c) == 1) {
+				ch = c;
+				blob_append(out, &ch, 1);
+				p += 2;
+			} else
+				blob_append(out, p, 1);
+		}
+		return (0);
+	}
+	return (-1);
+}
+
+static void
+websub_reply(int fd, int status, const char *reason, const char *body)
+{
+	dprintf(fd, "HTTP/1.0 %d %s\r\n"
+	    "Content-Type: text/plain\r\n"
+	    "Content-Length: %zu\r\n"
+	    "Connection: close\r\n"
+	    "\r\n%s", status, reason, strlen(body), body);
+}
+
+/* verification of (un)subscription intent, or denial */
+static void
+websub_verification(int fd, int chanid, const char *query)
+{
+	Blob mode = empty_blob, topic = empty_blob, challenge = empty_blob;
+	Blob lease = empty_blob;
+	long seconds;
+	int known;
+
+	websub_param(&mode, query, "hub.mode");
+	websub_param(&topic, query, "hub.topic");
+	websub_param(&challenge, query, "hub.challenge");
+	websub_param(&lease, query, "hub.lease_seconds");
+	known = db_exists("SELECT 1 FROM subscriptions WHERE chanid = %d "
+				"AND topic = '%q' AND requested > 0",
+				chanid, blob_str(&topic));
+	if (strcmp(blob_str(&mode), "denied") == 0) {
+		if (known) {
+			printf("Subscription of channel %d denied.\n", chanid);
+			db_multi_exec("DELETE FROM subscriptions "
+					"WHERE chanid = %d", chanid);
+		}
+		websub_reply(fd, 200, "OK", "");
+	} else if (!known || blob_size(&challenge) == 0) {
+		websub_reply(fd, 404, "Not Found", "");
+	} else if (strcmp(blob_str(&mode), "subscribe") == 0) {
+		if ((seconds = strtol(blob_str(&lease), NULL, 10)) <= 0)
+			seconds = WEBSUB_LEASE;
+		db_multi_exec("UPDATE subscriptions SET expires = %ld "
+				"WHERE chanid = %d",
+				(long)(time(NULL) + seconds), chanid);
+		printf("Subscription of channel %d verified for %ld s.\n",
+		    chanid, seconds);
+		websub_reply(fd, 200, "OK", blob_str(&challenge));
+	} else if (strcmp(blob_str(&mode), "unsubscribe") == 0) {
+		db_multi_exec("DELETE FROM subscriptions WHERE chanid = %d",
+				chanid);
+		websub_reply(fd, 200, "OK", blob_str(&challenge));
+	} else
+		websub_reply(fd, 404, "Not Found", "");
+	blob_reset(&mode);
+	blob_reset(&topic);
+	blob_reset(&challenge);
+	blob_reset(&lease);
+}
+
+/* content distribution, returns the number of new items */
+static int
+websub_content(int chanid, const char *signature, Blob *body, int maxitems)
+{
+	struct feed *rss;
+	char *secret;
+	long tagid;
+	int count, sniff;
+
+	if ((secret = db_text(NULL, "SELECT secret FROM subscriptions "
+				"WHERE chanid = %d AND expires > %ld",
+				chanid, (long)time(NULL))) == NULL) {
+		dmsg(0, "%s: %d: not subscribed", __func__, chanid);
+		return (0);
+	}
+	/* a bad signature is acknowledged and dropped */
+	if (websub_verify(secret, signature, blob_buffer(body),
+	    blob_size(body)) == -1) {
+		printf("rss id [%d] pushed with bad signature.\n", chanid);
+		fossil_free(secret);
+		return (0);
+	}
+	fossil_free(secret);
+	sniff = rss_sniff(blob_buffer(body), blob_size(body));
+	metrics_sniff(sniff);
+	if (sniff == RSS_SNIFF_REJECT) {
+		printf("rss id [%d] is not a feed.\n", chanid);
+		return (0);
+	}
+	if ((rss = rss_parse_buffer(blob_buffer(body), blob_size(body),
+	    maxitems, 0)) == NULL) {
+		printf("rss id [%d] cannot be parsed.\n", chanid);
+		metrics_add(M_PARSE_ERRORS, 1);
+		return (0);
+	}
+	tagid = db_int(-1, "SELECT tagid FROM channels WHERE id = %d", chanid);
+	if ((count = store_feed(chanid, rss)) > 0 && tagid != -1)
+		summary_mark(tagid);
+	return (count);
+}
+
+/* read request of the hub and answer it */
+static int
+websub_handle(int fd, size_t body_max, int maxitems)
+{
+	Blob body = empty_blob;
+	char line[8192], method[8], *target, *query, *p, *signature = NULL;
+	long length = -1;
+	int chanid, count = 0;
+	FILE *in;
+
+	if ((in = fdopen(fd, "r")) == NULL)
+		return (0);
+	if (fgets(line, sizeof(line), in) == NULL ||
+	    sscanf(line, "%7s", method) != 1 ||
+	    (target = strchr(line, ' ')) == NULL) {
+		websub_reply(fd, 400, "Bad Request", "");
+		goto done;
+	}
+	target++;
+	target[strcspn(target, " \r\n")] = 0;
+	if ((target = strdup(target)) == NULL) {
+		fprintf(stderr, "%s: %s\n", __func__, strerror(errno));
+		exit(1);
+	}
+	while (fgets(line, sizeof(line), in) != NULL &&
+	    strcmp(line, "\r\n") != 0 && strcmp(line, "\n") != 0) {
+		line[strcspn(line, "\r\n")] = 0;
+		if ((p = strchr(line, ':')) == NULL)
+			continue;
+		for (*p++ = 0; *p == ' ' || *p == '\t'; p++)
+			;
+		if (strcasecmp(line, "Content-Length") == 0)
+			length = strtol(p, NULL, 10);
+		else if (strcasecmp(line, "X-Hub-Signature") == 0 &&
+		    signature == NULL && (signature = strdup(p)) == NULL) {
+			fprintf(stderr, "%s: %s\n", __func__, strerror(errno));
+			exit(1);
+		}
+	}
+	/* callback/<channel id>[?query] */
+	if ((query = strchr(target, '?')) != NULL)
+		*query++ = 0;
+	p = strrchr(target, '/');
+	if (p == NULL || (chanid = strtol(p + 1, &p, 10)) <= 0 || *p != 0) {
+		websub_reply(fd, 404, "Not Found", "");
+	} else if (strcmp(method, "GET") == 0) {
+		websub_verification(fd, chanid, query ? query : "");
+	} else if (strcmp(method, "POST") != 0) {
+		websub_reply(fd, 405, "Method Not Allowed", "");
+	} else if (length < 0) {
+		websub_reply(fd, 411, "Length Required", "");
+	} else if ((size_t)length > body_max) {
+		websub_reply(fd, 413, "Payload Too Large", "");
+	} else {
+		blob_resize(&body, length);
+		if (fread(blob_buffer(&body), 1, length, in) !=
+		    (size_t)length) {
+			websub_reply(fd, 400, "Bad Request", "");
+		} else {
+			/* the hub does not wait for the database */
+			websub_reply(fd, 202, "Accepted", "");
+			shutdown(fd, SHUT_WR);
+			count = websub_content(chanid, signature, &body,
+			    maxitems);
+		}
+		blob_reset(&body);
+	}
+	free(target);
+done:
+	free(signature);
+	fclose(in);
+	return (count);
+}
+
+/* receive pushes on [host:]port, does not return */
+void
+websub_serve(const char *listen_on, size_t body_max, int maxitems,
+    const char *htmldir, const char *outdir, int items)
+{
+	struct addrinfo hints, *res;
+	struct timeval tv = { WEBSUB_TIMEOUT, 0 };
+	char host[256], *port;
+	int s, fd, on = 1, rc;
+
+	snprintf(host, sizeof(host), "%s", listen_on);
+	if ((port = strrchr(host, ':')) != NULL)
+		*port++ = 0;
+	else
+		port = host;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+	if ((rc = getaddrinfo(port == host ? NULL : host, port, &hints,
+	    &res)) != 0) {
+		fprintf(stderr, "%s: %s: %s\n", __func__, listen_on,
+		    gai_strerror(rc));
+		exit(1);
+	}
+	if ((s = socket(res->ai_family, res->ai_socktype,
+	    res->ai_protocol)) == -1 ||
+	    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) == -1 ||
+	    bind(s, res->ai_addr, res->ai_addrlen) == -1 ||
+	    listen(s, 16) == -1) {
+		fprintf(stderr, "%s: %s: %s\n", __func__, listen_on,
+		    strerror(errno));
+		exit(1);
+	}
+	freeaddrinfo(res);
+	signal(SIGPIPE, SIG_IGN);
+	dmsg(0, "%s: listening on %s", __func__, listen_on);
+	for (;;) {
+		if ((fd = accept(s, NULL, NULL)) == -1) {
+			if (errno != EINTR)
+				fprintf(stderr, "%s: %s\n", __func__,
+				    strerror(errno));
+			continue;
+		}
+		/* a slow hub cannot hold the receiver */
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+		if (websub_handle(fd, body_max, maxitems) > 0 && outdir)
+			summary_update(htmldir, outdir, items);
+		fflush(stdout);
+	}
+}
@@ -0,0 +1,345 @@
+/*
+ * Copyright (c) 2026 Nikola Kolev <koue@chaosophia.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/*
+ * Compressed descriptions.
+ *
+ * Descriptions longer than ZDESC_MIN bytes are stored as blob:
+ *
+ *   'Z' | dictionary id (4 bytes) | text size (4 bytes) | zlib stream
+ *
+ * The zlib stream is primed with a shared dictionary (table dictionary)
+ * trained from the stored descriptions (rssroll -T). Dictionary 0 means
+ * no dictionary. Old dictionaries are kept, the blob always refers to the
+ * one it has been compressed with.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <zlib.h>
+
+#include <fslbase.h>
+#include <fsldb.h>
+#include <sqlite3.h>
+
+#include "rss.h"
+
+#define	ZDESC_MAGIC	'Z'
+#define	ZDESC_HEADER	9
+#define	ZDESC_MIN	2048
+#define	ZDESC_DICTSIZE	(32 * 1024)	/* zlib window */
+
+static unsigned char	*zdict_data = NULL;
+static int		zdict_len = 0;
+static int		zdict_id = 0;
+
+static void
+zdesc_put32(unsigned char *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static uint32_t
+zdesc_get32(const unsigned char *p)
+{
+	return ((uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+	    (uint32_t)p[2] << 8 | (uint32_t)p[3]);
+}
+
+/* load dictionary, only the last one is kept in memory */
+static int
+zdesc_dict(int id)
+{
+	Stmt q;
+	int rc = -1;
+
+	if (id == zdict_id)
+		return (0);
+	db_prepare(&q, "SELECT data FROM dictionary WHERE id = %d", id);
+	if (db_step(&q) == SQLITE_ROW) {
+		free(zdict_data);
+		zdict_len = db_column_bytes(&q, 0);
+		if ((zdict_data = malloc(zdict_len)) == NULL) {
+			zdict_len = zdict_id = 0;
+			goto done;
+		}
+		memcpy(zdict_data, db_column_raw(&q, 0), zdict_len);
+		zdict_id = id;
+		rc = 0;
+	}
+done:
+	db_finalize(&q);
+	return (rc);
+}
+
+/* use the newest dictionary for compression */
+void
+zdesc_init(void)
+{
+	int id;
+
+	if ((id = db_int(0, "SELECT max(id) FROM dictionary")) > 0)
+		zdesc_dict(id);
+}
+
+/* returns -1 if text should be stored as it is */
+int
+zdesc_compress(Blob *out, const char *text)
+{
+	z_stream z;
+	size_t len = text ? strlen(text) : 0;
+	unsigned long bound;
+	unsigned char *p;
+	int rc;
+
+	if (len < ZDESC_MIN)
+		return (-1);
+	memset(&z, 0, sizeof(z));
+	if (deflateInit(&z, Z_BEST_COMPRESSION) != Z_OK)
+		return (-1);
+	if (zdict_len)
+		deflateSetDictionary(&z, zdict_data, zdict_len);
+	bound = deflateBound(&z, len);
+	blob_resize(out, ZDESC_HEADER + bound);
+	p = (unsigned char *)blob_buffer(out);
+	p[0] = ZDESC_MAGIC;
+	zdesc_put32(p + 1, zdict_id);
+	zdesc_put32(p + 5, len);
+	z.next_in = (unsigned char *)text;
+	z.avail_in = len;
+	z.next_out = p + ZDESC_HEADER;
+	z.avail_out = bound;
+	rc = deflate(&z, Z_FINISH);
+	deflateEnd(&z);
+	if (rc != Z_STREAM_END || ZDESC_HEADER + z.total_out >= len) {
+		blob_reset(out);
+		return (-1);
+	}
+	blob_resize(out, ZDESC_HEADER + z.total_out);
+	return (0);
+}
+
+/* inflate compressed description, out() is called for every chunk */
+static int
+zdesc_inflate(const char *zdesc, int size,
+    void (*out)(const char *, size_t, void *), void *arg)
+{
+	const unsigned char *p = (const unsigned char *)zdesc;
+	unsigned char buf[16384];
+	z_stream z;
+	int rc;
+
+	if (size < ZDESC_HEADER || p[0] != ZDESC_MAGIC)
+		return (-1);
+	if (zdesc_get32(p + 1) && zdesc_dict(zdesc_get32(p + 1)) == -1)
+		return (-1);
+	memset(&z, 0, sizeof(z));
+	if (inflateInit(&z) != Z_OK)
+		return (-1);
+	z.next_in = (unsigned char *)p + ZDESC_HEADER;
+	z.avail_in = size - ZDESC_HEADER;
+	do {
+		z.next_out = buf;
+		z.avail_out = sizeof(buf);
+		rc = inflate(&z, Z_NO_FLUSH);
+		if (rc == Z_NEED_DICT) {
+			rc = inflateSetDictionary(&z, zdict_data, zdict_len);
+			continue;
+		}
+		out((const char *)buf, sizeof(buf) - z.avail_out, arg);
+	} while (rc == Z_OK);
+	inflateEnd(&z);
+	return (rc == Z_STREAM_END ? 0 : -1);
+}
+
+static void
+zdesc_out_file(const char *buf, size_t len, void *arg)
+{
+	fwrite(buf, 1, len, (FILE *)arg);
+}
+
+static void
+zdesc_out_blob(const char *buf, size_t len, void *arg)
+{
+	blob_append((Blob *)arg, buf, len);
+}
+
+int
+zdesc_write(FILE *out, const char *zdesc, int size)
+{
+	return (zdesc_inflate(zdesc, size, zdesc_out_file, out));
+}
+
+/* append description from column col, compressed or not, into out */
+void
+zdesc_column(Stmt *q, int col, Blob *out)
+{
+	if (db_column_type(q, col) == SQLITE_BLOB) {
+		zdesc_inflate(db_column_raw(q, col), db_column_bytes(q, col),
+		    zdesc_out_blob, out);
+	} else if (db_column_type(q, col) != SQLITE_NULL) {
+		blob_append(out, db_column_text(q, col), -1);
+	}
+}
+
+/*
+ * Dictionary training.
+ *
+ * The sample descriptions are cut into segments (markup tags and words
+ * with their trailing space). Segments seen at least ZDESC_MINSEEN times
+ * are scored by count * length and the best of them fill the dictionary.
+ * zlib finds the strings at the end of the dictionary with the shortest
+ * distances, the best segments are put there.
+ */
+
+#define	ZDESC_SAMPLES	2000
+#define	ZDESC_MINSEEN	3
+#define	ZDESC_BUCKETS	(1 << 18)
+#define	ZDESC_MAXSEGS	(ZDESC_BUCKETS / 4 * 3)	/* keeps the probes short */
+
+struct zdesc_seg {
+	const char *p;
+	int len;
+	int count;
+};
+
+static int
+zdesc_seg_cmp(const void *a, const void *b)
+{
+	const struct zdesc_seg *x = a, *y = b;
+	long sx = (long)x->count * x->len, sy = (long)y->count * y->len;
+
+	return ((sx < sy) - (sx > sy));
+}
+
+/* count segment, new ones are dropped once the table is 3/4 full */
+static void
+zdesc_seg_add(struct zdesc_seg *segs, int *nsegs, const char *p, int len)
+{
+	uint32_t hash = 2166136261U;
+	int i;
+
+	if (len < 4 || len > 256)
+		return;
+	for (i = 0; i < len; i++)
+		hash = (hash ^ (unsigned char)p[i]) * 16777619U;
+	for (i = hash & (ZDESC_BUCKETS - 1); segs[i].p;
+	    i = (i + 1) & (ZDESC_BUCKETS - 1)) {
+		if (segs[i].len == len && memcmp(segs[i].p, p, len) == 0) {
+			segs[i].count++;
+			return;
+		}
+	}
+	if (*nsegs >= ZDESC_MAXSEGS)
+		return;
+	(*nsegs)++;
+	segs[i].p = p;
+	segs[i].len = len;
+	segs[i].count = 1;
+}
+
+void
+zdesc_train(void)
+{
+	Blob sample = empty_blob, dict = empty_blob;
+	struct zdesc_seg *segs;
+	const char *p, *start;
+	int i, n = 0, used = 0, total = 0, nsegs = 0;
+	Stmt q;
+
+	if ((segs = calloc(ZDESC_BUCKETS, sizeof(struct zdesc_seg))) == NULL) {
+		fprintf(stderr, "%s: cannot allocate memory\n", __func__);
+		return;
+	}
+	db_prepare(&q, "SELECT description FROM feeds ORDER BY id DESC LIMIT %d",
+	    ZDESC_SAMPLES);
+	while (db_step(&q) == SQLITE_ROW) {
+		zdesc_column(&q, 0, &sample);
+		blob_append(&sample, "", 1);
+		n++;
+	}
+	db_finalize(&q);
+
+	/* segments must not move, the sample is complete at this point */
+	p = blob_buffer(&sample);
+	while (p && p < blob_buffer(&sample) + blob_size(&sample)) {
+		start = p;
+		if (*p == '<') {
+			while (*p && *p != '>')
+				p++;
+			if (*p)
+				p++;
+		} else {
+			while (*p && *p != '<' && *p != ' ')
+				p++;
+			if (*p == ' ')
+				p++;
+		}
+		if (p == start) {
+			p++;
+			continue;
+		}
+		zdesc_seg_add(segs, &nsegs, start, p - start);
+	}
+
+	/* pack the best segments, in the zlib window every one would fit */
+	for (i = 0; i < ZDESC_BUCKETS; i++) {
+		if (segs[i].count >= ZDESC_MINSEEN)
+			segs[used++] = segs[i];
+	}
+	qsort(segs, used, sizeof(struct zdesc_seg), zdesc_seg_cmp);
+	for (i = 0; i < used && total + segs[i].len <= ZDESC_DICTSIZE; i++)
+		total += segs[i].len;
+	for (i--; i >= 0; i--)
+		blob_append(&dict, segs[i].p, segs[i].len);
+
+	if (blob_size(&dict)) {
+		db_prepare(&q, "INSERT INTO dictionary (created, data) "
+				"VALUES (%ld, :data)", (long)time(NULL));
+		db_bind_blob(&q, ":data", &dict);
+		db_step(&q);
+		db_finalize(&q);
+		printf("Dictionary %d has been trained from %d descriptions "
+		    "(%d bytes).\n", db_int(0, "SELECT max(id) FROM dictionary"),
+		    n, blob_size(&dict));
+	} else {
+		printf("Not enough descriptions to train a dictionary.\n");
+	}
+	blob_reset(&sample);
+	blob_reset(&dict);
+	free(segs);
+}
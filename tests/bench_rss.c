@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2026 Nikola Kolev <koue@chaosophia.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Throughput benchmark of rss_parse_buffer().
+ *
+ * Every file is parsed in memory for at least BENCH_SECONDS and the
+ * throughput is reported in MB/s and items/s, per feed version.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "rss.h"
+
+#define	BENCH_SECONDS	1.0
+
+int debug = 0;
+
+static const char *versions[] = {
+	"RSS 0.90", "RSS 0.91", "RSS 0.92", "RSS 0.93", "RSS 0.94",
+	"RSS 1.0", "RSS 2.0", "Atom 0.1", "Atom 0.2", "Atom 0.3"
+};
+
+static double
+bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+static char *
+bench_load(const char *fn, size_t *size)
+{
+	FILE *fp;
+	char *buf;
+	long len;
+
+	if ((fp = fopen(fn, "r")) == NULL)
+		return (NULL);
+	fseek(fp, 0, SEEK_END);
+	len = ftell(fp);
+	rewind(fp);
+	if ((buf = malloc(len + 1)) == NULL ||
+	    fread(buf, 1, len, fp) != (size_t)len) {
+		free(buf);
+		fclose(fp);
+		return (NULL);
+	}
+	buf[len] = 0;
+	fclose(fp);
+	*size = len;
+	return (buf);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct feed *rss;
+	struct item *item;
+	double start, elapsed;
+	size_t size;
+	long runs, items;
+	char *buf;
+	int i, version;
+
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s file ...\n", argv[0]);
+		return (1);
+	}
+	printf("%-16s %-9s %8s %10s %12s\n", "file", "version", "bytes",
+	    "MB/s", "items/s");
+	for (i = 1; i < argc; i++) {
+		if ((buf = bench_load(argv[i], &size)) == NULL) {
+			fprintf(stderr, "%s: cannot read\n", argv[i]);
+			return (1);
+		}
+		runs = items = 0;
+		version = -1;
+		start = bench_now();
+		do {
+			if ((rss = rss_parse_buffer(buf, size, 0, 0)) == NULL) {
+				fprintf(stderr, "%s: cannot parse\n", argv[i]);
+				return (1);
+			}
+			version = rss->version;
+			TAILQ_FOREACH(item, &rss->items_list, entry)
+				items++;
+			rss_close(rss);
+			runs++;
+		} while ((elapsed = bench_now() - start) < BENCH_SECONDS);
+		printf("%-16s %-9s %8zu %10.2f %12.0f\n", argv[i],
+		    versions[version], size, runs * size / elapsed / 1e6,
+		    items / elapsed);
+		free(buf);
+	}
+	return (0);
+}
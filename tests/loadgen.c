@@ -0,0 +1,683 @@
+/*
+ * Copyright (c) 2026 Nikola Kolev <koue@chaosophia.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Load generator for index.cgi.
+ *
+ * -g builds a synthetic database of the given number of items (tags,
+ * channels, feeds and the search index) from scripts/database_create.sql.
+ * The requests are a mix of the page kinds seen in the access logs: the
+ * default page, the first page of a tag, a tag at a deep offset, a
+ * channel page and a search. Every request is timed and the run reports
+ * the throughput, p50/p99/p999 latency, CPU per request and the latency
+ * of every request kind.
+ *
+ * By default every request spawns index.cgi --valgrind (the database is
+ * rssrolltest.db, run it from tests/), the CPU of the child is taken from
+ * wait4(). With -u the requests go over HTTP to a running web server,
+ * which covers whatever keeps the frontend persistent there, the CPU is
+ * not known then.
+ */
+
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sqlite3.h>
+
+#define	LOAD_TAGS	10
+#define	LOAD_CHANITEMS	100	/* items per synthetic channel */
+#define	LOAD_PAGE	10	/* feeds= of etc/rssrollrc */
+#define	LOAD_BUFSIZE	65536
+
+extern char **environ;
+
+enum { Q_DEFAULT, Q_TAG, Q_DEEP, Q_CHANNEL, Q_SEARCH, Q_KINDS };
+
+static const char *kinds[Q_KINDS] = {
+	"default", "tag", "deep", "channel", "search"
+};
+
+/* share of the requests in percent, in the order of kinds[] */
+static const int mix[Q_KINDS] = { 10, 35, 15, 30, 10 };
+
+static const char *words[] = {
+	"feed", "release", "kernel", "network", "storage", "security",
+	"update", "patch", "driver", "memory", "cache", "server", "client",
+	"archive", "library", "compiler", "thread", "socket", "packet",
+	"filter", "router", "wireless", "graphics", "audio", "video",
+	"desktop", "mobile", "cloud", "cluster", "database", "index",
+	"query", "search", "crawler", "parser", "syntax", "markup", "style",
+	"script", "module", "package", "port", "build", "test", "bench",
+	"profile", "trace", "debug", "error", "warning", "notice", "report",
+	"review", "commit", "branch", "merge", "tag", "version", "stable",
+	"current", "legacy", "future", "history", "summary"
+};
+#define	NWORDS	(sizeof(words) / sizeof(words[0]))
+
+struct sample {
+	double ms;
+	double cpu_user;
+	double cpu_sys;
+	size_t bytes;
+	int kind;
+	int failed;
+};
+
+static struct {
+	pthread_mutex_t lock;
+	int next;
+	int total;
+	struct sample *samples;
+	char **cmd;
+	struct addrinfo *addr;
+	char host[256];
+	char path[256];
+	long tagitems[LOAD_TAGS + 1];
+	long channels;
+	long chanitems;
+} load = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static double
+load_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+static int
+load_exec(sqlite3 *db, const char *sql)
+{
+	char *err;
+
+	if (sqlite3_exec(db, sql, NULL, NULL, &err) != SQLITE_OK) {
+		fprintf(stderr, "%s: %s\n", __func__, err);
+		sqlite3_free(err);
+		return (-1);
+	}
+	return (0);
+}
+
+static void
+load_words(char *buf, size_t size, int count, unsigned int *seed)
+{
+	size_t len = 0;
+	int i;
+
+	buf[0] = 0;
+	for (i = 0; i < count && len < size; i++)
+		len += snprintf(buf + len, size - len, "%s%s", i ? " " : "",
+		    words[rand_r(seed) % NWORDS]);
+}
+
+/* synthetic database, about LOAD_CHANITEMS items per channel */
+static int
+load_generate(const char *dbpath, long items, unsigned int seed)
+{
+	sqlite3 *db;
+	sqlite3_stmt *chan, *feed, *fts;
+	char *schema, link[128], title[128], desc[512], text[256];
+	long channels, i;
+	time_t now = time(NULL);
+	double start = load_now(), u;
+	FILE *fp;
+	long len;
+
+	if ((fp = fopen("../scripts/database_create.sql", "r")) == NULL) {
+		fprintf(stderr, "%s: database_create.sql: %s\n", __func__,
+		    strerror(errno));
+		return (-1);
+	}
+	fseek(fp, 0, SEEK_END);
+	len = ftell(fp);
+	rewind(fp);
+	if ((schema = calloc(1, len + 1)) == NULL ||
+	    fread(schema, 1, len, fp) != (size_t)len) {
+		fprintf(stderr, "%s: database_create.sql: cannot read\n",
+		    __func__);
+		fclose(fp);
+		free(schema);
+		return (-1);
+	}
+	fclose(fp);
+	unlink(dbpath);
+	if (sqlite3_open(dbpath, &db) != SQLITE_OK) {
+		fprintf(stderr, "%s: %s: %s\n", __func__, dbpath,
+		    sqlite3_errmsg(db));
+		free(schema);
+		return (-1);
+	}
+	if (load_exec(db, schema) == -1 ||
+	    load_exec(db, "PRAGMA synchronous = OFF; BEGIN") == -1)
+		goto fail;
+	for (i = 1; i <= LOAD_TAGS; i++) {
+		snprintf(desc, sizeof(desc), "INSERT INTO tags (title, "
+		    "description) VALUES ('tag%ld', 'synthetic tag %ld')",
+		    i, i);
+		if (load_exec(db, desc) == -1)
+			goto fail;
+	}
+	if ((channels = items / LOAD_CHANITEMS) == 0)
+		channels = 1;
+	sqlite3_prepare_v2(db, "INSERT INTO channels (tagid, link, title, "
+	    "site) VALUES (?, ?, ?, ?)", -1, &chan, NULL);
+	sqlite3_prepare_v2(db, "INSERT INTO feeds (chanid, modified, link, "
+	    "title, description, pubdate) VALUES (?, ?, ?, ?, ?, ?)", -1,
+	    &feed, NULL);
+	sqlite3_prepare_v2(db, "INSERT INTO feeds_fts (rowid, title, "
+	    "description) VALUES (?, ?, ?)", -1, &fts, NULL);
+	for (i = 1; i <= channels; i++) {
+		/* a few big tags and a long tail */
+		u = (double)rand_r(&seed) / ((double)RAND_MAX + 1);
+		sqlite3_bind_int(chan, 1, 1 + (int)(LOAD_TAGS * u * u));
+		snprintf(link, sizeof(link),
+		    "http://site%ld.example.net/feed.xml", i);
+		sqlite3_bind_text(chan, 2, link, -1, SQLITE_TRANSIENT);
+		load_words(title, sizeof(title), 3, &seed);
+		sqlite3_bind_text(chan, 3, title, -1, SQLITE_TRANSIENT);
+		snprintf(link, sizeof(link), "http://site%ld.example.net/", i);
+		sqlite3_bind_text(chan, 4, link, -1, SQLITE_TRANSIENT);
+		sqlite3_step(chan);
+		sqlite3_reset(chan);
+	}
+	for (i = 1; i <= items; i++) {
+		sqlite3_bind_int64(feed, 1, 1 + rand_r(&seed) % channels);
+		sqlite3_bind_int64(feed, 2, now);
+		snprintf(link, sizeof(link),
+		    "http://site%ld.example.net/item/%ld",
+		    1 + rand_r(&seed) % channels, i);
+		sqlite3_bind_text(feed, 3, link, -1, SQLITE_TRANSIENT);
+		load_words(title, sizeof(title), 6, &seed);
+		sqlite3_bind_text(feed, 4, title, -1, SQLITE_TRANSIENT);
+		load_words(text, sizeof(text), 28, &seed);
+		snprintf(desc, sizeof(desc), "<p>%s</p>", text);
+		sqlite3_bind_text(feed, 5, desc, -1, SQLITE_TRANSIENT);
+		sqlite3_bind_int64(feed, 6, now - (items - i) * 60);
+		sqlite3_step(feed);
+		sqlite3_reset(feed);
+		sqlite3_bind_int64(fts, 1, sqlite3_last_insert_rowid(db));
+		sqlite3_bind_text(fts, 2, title, -1, SQLITE_TRANSIENT);
+		sqlite3_bind_text(fts, 3, text, -1, SQLITE_TRANSIENT);
+		sqlite3_step(fts);
+		sqlite3_reset(fts);
+	}
+	sqlite3_finalize(chan);
+	sqlite3_finalize(feed);
+	sqlite3_finalize(fts);
+	if (load_exec(db, "COMMIT") == -1)
+		goto fail;
+	sqlite3_close(db);
+	free(schema);
+	printf("generated %s: %ld items, %ld channels, %d tags in %.1fs\n",
+	    dbpath, items, channels, LOAD_TAGS, load_now() - start);
+	return (0);
+fail:
+	sqlite3_close(db);
+	free(schema);
+	return (-1);
+}
+
+/* query space: items per tag, number of channels */
+static int
+load_scan(const char *dbpath)
+{
+	sqlite3 *db;
+	sqlite3_stmt *q;
+	long items = 0, tag;
+
+	if (sqlite3_open_v2(dbpath, &db, SQLITE_OPEN_READONLY, NULL) !=
+	    SQLITE_OK) {
+		fprintf(stderr, "%s: %s: %s\n", __func__, dbpath,
+		    sqlite3_errmsg(db));
+		sqlite3_close(db);
+		return (-1);
+	}
+	if (sqlite3_prepare_v2(db, "SELECT c.tagid, count(*) FROM feeds AS f "
+	    "JOIN channels AS c ON c.id = f.chanid GROUP BY c.tagid", -1, &q,
+	    NULL) != SQLITE_OK) {
+		fprintf(stderr, "%s: %s\n", __func__, sqlite3_errmsg(db));
+		sqlite3_close(db);
+		return (-1);
+	}
+	while (sqlite3_step(q) == SQLITE_ROW) {
+		tag = sqlite3_column_int64(q, 0);
+		if (tag >= 1 && tag <= LOAD_TAGS)
+			load.tagitems[tag] = sqlite3_column_int64(q, 1);
+		items += sqlite3_column_int64(q, 1);
+	}
+	sqlite3_finalize(q);
+	sqlite3_prepare_v2(db, "SELECT max(id) FROM channels", -1, &q, NULL);
+	if (sqlite3_step(q) == SQLITE_ROW)
+		load.channels = sqlite3_column_int64(q, 0);
+	sqlite3_finalize(q);
+	sqlite3_close(db);
+	if (load.channels == 0) {
+		fprintf(stderr, "%s: %s: no channels\n", __func__, dbpath);
+		return (-1);
+	}
+	load.chanitems = items / load.channels;
+	return (0);
+}
+
+/* random offset of a page below count items */
+static long
+load_offset(long count, unsigned int *seed)
+{
+	if (count <= LOAD_PAGE)
+		return (0);
+	return ((rand_r(seed) % (count / LOAD_PAGE)) * LOAD_PAGE);
+}
+
+static int
+load_query(char *buf, size_t size, unsigned int *seed)
+{
+	int kind, r, tag;
+
+	r = rand_r(seed) % 100;
+	for (kind = 0; kind < Q_KINDS - 1 && r >= mix[kind]; kind++)
+		r -= mix[kind];
+	tag = 1 + rand_r(seed) % LOAD_TAGS;
+	switch (kind) {
+	case Q_DEFAULT:
+		buf[0] = 0;
+		break;
+	case Q_TAG:
+		snprintf(buf, size, "%d", tag);
+		break;
+	case Q_DEEP:
+		snprintf(buf, size, "%d/%ld", tag,
+		    load_offset(load.tagitems[tag], seed));
+		break;
+	case Q_CHANNEL:
+		snprintf(buf, size, "0/%ld/%ld",
+		    1 + rand_r(seed) % load.channels,
+		    load_offset(load.chanitems, seed));
+		break;
+	case Q_SEARCH:
+		snprintf(buf, size, "q=%s", words[rand_r(seed) % NWORDS]);
+		break;
+	}
+	return (kind);
+}
+
+/* status of the CGI answer, 200 unless it starts with Status: */
+static int
+load_status(const char *buf, size_t len, int http)
+{
+	const char *p;
+
+	if (http) {
+		if (len < 12 || strncmp(buf, "HTTP/", 5) != 0 ||
+		    (p = memchr(buf, ' ', len)) == NULL)
+			return (-1);
+		return (atoi(p + 1));
+	}
+	if (len > 8 && strncmp(buf, "Status: ", 8) == 0)
+		return (atoi(buf + 8));
+	return (len ? 200 : -1);
+}
+
+/* read the answer, keep its first bytes for the status */
+static size_t
+load_drain(int fd, char *head, size_t size, size_t *hlen)
+{
+	char buf[LOAD_BUFSIZE];
+	size_t len = 0, n;
+	ssize_t r;
+
+	*hlen = 0;
+	while ((r = read(fd, buf, sizeof(buf))) > 0 ||
+	    (r == -1 && errno == EINTR)) {
+		if (r == -1)
+			continue;
+		if (*hlen < size) {
+			n = (size_t)r < size - *hlen ? (size_t)r : size - *hlen;
+			memcpy(head + *hlen, buf, n);
+			*hlen += n;
+		}
+		len += r;
+	}
+	return (len);
+}
+
+static void
+load_cgi(const char *query, struct sample *s)
+{
+	posix_spawn_file_actions_t fa;
+	struct rusage ru;
+	char env[128], head[64], *envp[4];
+	size_t len, hlen;
+	pid_t pid;
+	int fd[2], status;
+
+	snprintf(env, sizeof(env), "QUERY_STRING=%s", query);
+	envp[0] = env;
+	envp[1] = "REQUEST_METHOD=GET";
+	envp[2] = "SCRIPT_NAME=/cgi-bin/index.cgi";
+	envp[3] = NULL;
+	if (pipe(fd) == -1) {
+		s->failed = 1;
+		return;
+	}
+	posix_spawn_file_actions_init(&fa);
+	posix_spawn_file_actions_adddup2(&fa, fd[1], STDOUT_FILENO);
+	posix_spawn_file_actions_addclose(&fa, fd[0]);
+	posix_spawn_file_actions_addclose(&fa, fd[1]);
+	posix_spawn_file_actions_addopen(&fa, STDERR_FILENO, "/dev/null",
+	    O_WRONLY, 0);
+	if (posix_spawn(&pid, load.cmd[0], &fa, NULL, load.cmd, envp) != 0) {
+		posix_spawn_file_actions_destroy(&fa);
+		close(fd[0]);
+		close(fd[1]);
+		s->failed = 1;
+		return;
+	}
+	posix_spawn_file_actions_destroy(&fa);
+	close(fd[1]);
+	len = load_drain(fd[0], head, sizeof(head), &hlen);
+	close(fd[0]);
+	while (wait4(pid, &status, 0, &ru) == -1 && errno == EINTR)
+		;
+	s->bytes = len;
+	s->cpu_user = ru.ru_utime.tv_sec * 1e3 + ru.ru_utime.tv_usec / 1e3;
+	s->cpu_sys = ru.ru_stime.tv_sec * 1e3 + ru.ru_stime.tv_usec / 1e3;
+	status = WIFEXITED(status) && WEXITSTATUS(status) == 0 ?
+	    load_status(head, hlen, 0) : -1;
+	if (status < 0 || status >= 400)
+		s->failed = 1;
+}
+
+static void
+load_http(const char *query, struct sample *s)
+{
+	char req[512], head[64];
+	size_t len, hlen;
+	ssize_t n;
+	int fd, status;
+
+	if ((fd = socket(load.addr->ai_family, load.addr->ai_socktype,
+	    load.addr->ai_protocol)) == -1 ||
+	    connect(fd, load.addr->ai_addr, load.addr->ai_addrlen) == -1) {
+		if (fd != -1)
+			close(fd);
+		s->failed = 1;
+		return;
+	}
+	n = snprintf(req, sizeof(req), "GET %s%s%s HTTP/1.0\r\n"
+	    "Host: %s\r\nConnection: close\r\n\r\n", load.path,
+	    query[0] ? "?" : "", query, load.host);
+	if (write(fd, req, n) != n) {
+		close(fd);
+		s->failed = 1;
+		return;
+	}
+	len = load_drain(fd, head, sizeof(head), &hlen);
+	close(fd);
+	s->bytes = len;
+	status = load_status(head, hlen, 1);
+	if (status < 0 || status >= 400)
+		s->failed = 1;
+}
+
+static void *
+load_worker(void *arg)
+{
+	unsigned int seed = (unsigned int)(uintptr_t)arg;
+	char query[64];
+	struct sample *s;
+	double start;
+	int i;
+
+	for (;;) {
+		pthread_mutex_lock(&load.lock);
+		i = load.next++;
+		pthread_mutex_unlock(&load.lock);
+		if (i >= load.total)
+			break;
+		s = &load.samples[i];
+		s->kind = load_query(query, sizeof(query), &seed);
+		start = load_now();
+		if (load.addr)
+			load_http(query, s);
+		else
+			load_cgi(query, s);
+		s->ms = (load_now() - start) * 1e3;
+	}
+	return (NULL);
+}
+
+static int
+load_cmp(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return ((x > y) - (x < y));
+}
+
+static double
+load_pct(const double *v, int n, double pct)
+{
+	int i = (int)(n * pct / 100.0);
+
+	return (n ? v[i < n ? i : n - 1] : 0);
+}
+
+static void
+load_report(double elapsed, int cgi)
+{
+	double *all, *kind, user = 0, sys = 0, bytes = 0;
+	int i, k, n, failed = 0;
+
+	if ((all = calloc(load.total, sizeof(double))) == NULL ||
+	    (kind = calloc(load.total, sizeof(double))) == NULL) {
+		fprintf(stderr, "%s: %s\n", __func__, strerror(errno));
+		exit(1);
+	}
+	for (i = 0; i < load.total; i++) {
+		all[i] = load.samples[i].ms;
+		user += load.samples[i].cpu_user;
+		sys += load.samples[i].cpu_sys;
+		bytes += load.samples[i].bytes;
+		failed += load.samples[i].failed;
+	}
+	qsort(all, load.total, sizeof(double), load_cmp);
+	printf("requests      %d (%d failed) in %.2fs, %.1f req/s\n",
+	    load.total, failed, elapsed, load.total / elapsed);
+	printf("latency ms    min %.2f p50 %.2f p99 %.2f p999 %.2f max %.2f\n",
+	    all[0], load_pct(all, load.total, 50),
+	    load_pct(all, load.total, 99), load_pct(all, load.total, 99.9),
+	    all[load.total - 1]);
+	if (cgi)
+		printf("cpu ms/req    user %.2f sys %.2f\n", user / load.total,
+		    sys / load.total);
+	printf("bytes/req     %.0f\n", bytes / load.total);
+	printf("%-10s %8s %10s %10s\n", "kind", "count", "p50 ms", "p99 ms");
+	for (k = 0; k < Q_KINDS; k++) {
+		for (i = n = 0; i < load.total; i++) {
+			if (load.samples[i].kind == k)
+				kind[n++] = load.samples[i].ms;
+		}
+		qsort(kind, n, sizeof(double), load_cmp);
+		printf("%-10s %8d %10.2f %10.2f\n", kinds[k], n,
+		    load_pct(kind, n, 50), load_pct(kind, n, 99));
+	}
+	free(all);
+	free(kind);
+}
+
+/* http://host[:port]/path */
+static int
+load_url(const char *url)
+{
+	struct addrinfo hints;
+	const char *p, *port = "80";
+	char *colon;
+	int error;
+
+	if (strncmp(url, "http://", 7) != 0)
+		return (-1);
+	url += 7;
+	if ((p = strchr(url, '/')) == NULL)
+		p = url + strlen(url);
+	if ((size_t)(p - url) >= sizeof(load.host))
+		return (-1);
+	memcpy(load.host, url, p - url);
+	load.host[p - url] = 0;
+	snprintf(load.path, sizeof(load.path), "%s", *p ? p : "/");
+	if ((colon = strrchr(load.host, ':')) != NULL &&
+	    strchr(colon, ']') == NULL) {
+		*colon = 0;
+		port = colon + 1;
+	}
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (load.host[0] == '[') {
+		memmove(load.host, load.host + 1, strlen(load.host));
+		load.host[strcspn(load.host, "]")] = 0;
+	}
+	if ((error = getaddrinfo(load.host, port, &hints, &load.addr)) != 0) {
+		fprintf(stderr, "%s: %s: %s\n", __func__, load.host,
+		    gai_strerror(error));
+		return (-1);
+	}
+	return (0);
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "Usage: loadgen [-c concurrency] [-d database] "
+	    "[-g items] [-n requests]\n"
+	    "               [-r seed] [-u url | -x command]\n");
+	exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *dbpath = "rssrolltest.db", *url = NULL;
+	char *command = "../src/index.cgi --valgrind", *p;
+	unsigned int seed = 1;
+	pthread_t *workers;
+	long items = 0;
+	double start;
+	int ch, i, concurrency = 4, n;
+
+	while ((ch = getopt(argc, argv, "c:d:g:n:r:u:x:")) != -1) {
+		switch (ch) {
+		case 'c':
+			concurrency = atoi(optarg);
+			break;
+		case 'd':
+			dbpath = optarg;
+			break;
+		case 'g':
+			items = strtol(optarg, NULL, 10);
+			break;
+		case 'n':
+			load.total = atoi(optarg);
+			break;
+		case 'r':
+			seed = strtoul(optarg, NULL, 10);
+			break;
+		case 'u':
+			url = optarg;
+			break;
+		case 'x':
+			command = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (concurrency < 1 || load.total < 0 || items < 0 || optind != argc)
+		usage();
+	if (items && load_generate(dbpath, items, seed) == -1)
+		return (1);
+	if (load.total == 0)
+		return (0);
+	if (load_scan(dbpath) == -1)
+		return (1);
+	if (url) {
+		if (load_url(url) == -1) {
+			fprintf(stderr, "loadgen: %s: bad url\n", url);
+			return (1);
+		}
+	} else {
+		/* split command into argv */
+		if ((load.cmd = calloc(strlen(command) / 2 + 2,
+		    sizeof(char *))) == NULL || (command = strdup(command)) ==
+		    NULL) {
+			fprintf(stderr, "loadgen: %s\n", strerror(errno));
+			return (1);
+		}
+		for (n = 0; (p = strsep(&command, " ")) != NULL;) {
+			if (*p)
+				load.cmd[n++] = p;
+		}
+		if (n == 0 || access(load.cmd[0], X_OK) == -1) {
+			fprintf(stderr, "loadgen: %s: not executable\n",
+			    n ? load.cmd[0] : "command");
+			return (1);
+		}
+	}
+	if ((load.samples = calloc(load.total, sizeof(struct sample))) ==
+	    NULL || (workers = calloc(concurrency, sizeof(pthread_t))) ==
+	    NULL) {
+		fprintf(stderr, "loadgen: %s\n", strerror(errno));
+		return (1);
+	}
+	printf("%s %s, %d requests, concurrency %d\n", url ? "http" : "cgi",
+	    url ? url : load.cmd[0], load.total, concurrency);
+	start = load_now();
+	for (i = 0; i < concurrency; i++)
+		pthread_create(&workers[i], NULL, load_worker,
+		    (void *)(uintptr_t)(seed + i + 1));
+	for (i = 0; i < concurrency; i++)
+		pthread_join(workers[i], NULL);
+	load_report(load_now() - start, url == NULL);
+	return (0);
+}
@@ -44,6 +44,65 @@ _test_valgrind() {
     _print_footer
 }
 
+### Ingest test, the saved fixtures instead of the network
+_test_ingest() {
+    _print_header ingest
+    ../src/rssroll -d rssrolltest.db -f '*.xml'
+    _print_footer
+}
+
+### Snapshot test, the pages are the same from the mapped snapshot
+_test_snapshot() {
+    _print_header snapshot
+    ${TESTCMD} --snapshot
+    _runhtml "1:html/tag1.template:grep DOCTYPE"
+    _runhtml "0/1:html/channel1.template:grep DOCTYPE"
+    _runhtml "q=lenny:html/search.template:grep DOCTYPE"
+    rm -f rssrolltest.snap test.file
+    _print_footer
+}
+
+### Failure tracking, notexist.xml waits for its retry
+_test_failures() {
+    _print_header failures
+    _runquery "SELECT failures FROM channels WHERE id=6;1"
+    _runquery "SELECT error FROM channels WHERE id=6;unavailable"
+    _runquery "SELECT COUNT(*) FROM channels WHERE retry > 0;1"
+    ../src/rssroll -d rssrolltest.db | grep "1 failing channels wait"
+    _runquery "SELECT failures FROM channels WHERE id=6;1"
+    _print_footer
+}
+
+### OPML test, the links are validated and notexist.xml is left out
+_test_opml() {
+    _print_header opml
+    ../src/rssroll -d rssrolltest.db -I subscriptions.opml
+    _runquery "SELECT COUNT(*) FROM tags;2"
+    _runquery "SELECT COUNT(*) FROM channels;5"
+    _runquery "SELECT COUNT(*) FROM channels WHERE tagid=1;3"
+    _runquery "SELECT COUNT(*) FROM channels WHERE modified > 0;5"
+    _runquery "SELECT title FROM channels WHERE id=4;XML.com"
+    _runquery "SELECT COUNT(*) FROM feeds;28"
+    _runquery "SELECT COUNT(*) FROM feeds WHERE chanid=3;10"
+    test `../src/rssroll -d rssrolltest.db -E - | grep -c xmlUrl` = 5
+    _print_footer
+}
+
+### Sanitizer test, the markup is tokenized the way a browser does it
+_test_sanitize() {
+    _print_header sanitize
+    sqlite3 rssrolltest.db "INSERT INTO tags (title) VALUES ('test1')"
+    sqlite3 rssrolltest.db "INSERT INTO channels (tagid, link) VALUES (1, 'https://raw.githubusercontent.com/koue/rssroll/develop/tests/hostile.rss')"
+    ../src/rssroll -d rssrolltest.db -f hostile.rss
+    _runquery "SELECT COUNT(*) FROM feeds;6"
+    _runquery "SELECT COUNT(*) FROM feeds WHERE description LIKE '%script>%';0"
+    _runquery "SELECT COUNT(*) FROM feeds WHERE title='quote' AND description='<b title=\"a''\">x</b>'' >';1"
+    _runquery "SELECT COUNT(*) FROM feeds WHERE title='slash' AND description='<img src=\"x/onerror=alert(1)\">';1"
+    _runquery "SELECT COUNT(*) FROM feeds WHERE description='<a>x</a>';3"
+    _runquery "SELECT COUNT(*) FROM feeds WHERE title='breakout' AND description LIKE '<a href=\"http://x/&quot%onmouseover=alert(1)\">y</a>';1"
+    _print_footer
+}
+
 ### DB queries test
 _runquery() {
     QUERY=`echo "${1}" | cut -d ';' -f 1`
@@ -62,6 +121,9 @@ _test_db() {
     _runquery "SELECT title FROM tags WHERE id=2;test2"
     _runquery "SELECT COUNT(*) FROM channels;6"
     _runquery "SELECT COUNT(*) FROM channels WHERE tagid=1;3"
+    _runquery "SELECT title FROM channels WHERE id=2;WriteTheWeb"
+    _runquery "SELECT site FROM channels WHERE id=3;http://cafe.elharo.com"
+    _runquery "SELECT language FROM channels WHERE id=2;en-us"
     _runquery "SELECT COUNT(*) FROM feeds;28"
     _runquery "SELECT COUNT(*) FROM feeds WHERE chanid=3;10"
     _runquery "SELECT COUNT(*) FROM feeds WHERE chanid=5;9"
@@ -79,6 +141,12 @@ _test_db() {
     _runquery "SELECT COUNT(*) FROM feeds WHERE title IS NOT '(NULL)';22"
     _runquery "SELECT COUNT(*) FROM feeds WHERE link LIKE '%backissues%';9"
     _runquery "SELECT COUNT(*) FROM feeds WHERE description LIKE '%ok%';4"
+    _runquery "SELECT COUNT(*) FROM feeds WHERE description LIKE '%<img src=%lenny.gif%';1"
+    # LIKE sees the short descriptions only, the long ones are compressed
+    _runquery "SELECT id FROM feeds WHERE typeof(description) = 'blob';20"
+    _runquery "SELECT COUNT(*) FROM feeds_fts WHERE feeds_fts MATCH 'lenny';1"
+    _runquery "SELECT rowid FROM feeds_fts WHERE feeds_fts MATCH 'title:order';22"
+    _runquery "SELECT COUNT(*) FROM feeds_simhash;26"
     _print_footer
 }
 
@@ -114,6 +182,10 @@ _test_html() {
     _runhtml "2:html/tag2.template:grep DOCTYPE"
     # no tag html
     _runhtml "3:html/notag.template:grep DOCTYPE"
+    # search html
+    _runhtml "q=lenny:html/search.template:grep DOCTYPE"
+    # empty search html
+    _runhtml "q=+:html/wrongquery.template:grep 400"
     # wrong query html
     _runhtml "zxc/10:html/wrongquery.template:grep 400"
     # wrong query html
@@ -132,3 +204,16 @@ _db_load
 _test_valgrind
 _test_db
 _test_html
+_test_snapshot
+_test_failures
+_clean
+_db_create
+_db_load
+_test_ingest
+_test_db
+_clean
+_db_create
+_test_opml
+_clean
+_db_create
+_test_sanitize
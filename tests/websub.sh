@@ -0,0 +1,64 @@
+#!/bin/sh
+#
+# WebSub end to end: the crawl discovers the stand-in hub (websub_hub.py)
+# and subscribes, the hub verifies the receiver (rssroll -W) and pushes
+# atom.xml as new content of the channel.
+#
+set -e
+
+HUB=127.0.0.1:18080
+PUSH=127.0.0.1:18081
+RSSROLL="../src/rssroll -d rssrolltest.db"
+SQLITERUN="sqlite3 rssrolltest.db"
+
+_print_header() {
+    echo
+    echo "===== Run ${1} test ====="
+}
+
+_print_footer() {
+    echo "OK"
+    echo "===== Done ====="
+}
+
+# wait for the asynchronous part, query;result
+_wait() {
+    QUERY=`echo "${1}" | cut -d ';' -f 1`
+    RESULT=`echo "${1}" | cut -d ';' -f 2`
+
+    for i in 1 2 3 4 5 6 7 8 9 10
+    do
+        [ `${SQLITERUN} "${QUERY}"` = "${RESULT}" ] && return 0
+        sleep 1
+    done
+    echo " '${QUERY}' failed"
+    exit 1
+}
+
+_publish() {
+    python3 -c 'import sys, urllib.request; urllib.request.urlopen(sys.argv[1], b"").read()' \
+        "http://${HUB}/publish?file=${1}"
+}
+
+rm -f rssrolltest.db websub.prom
+sqlite3 rssrolltest.db < ../scripts/database_create.sql
+${SQLITERUN} "INSERT INTO tags (title) VALUES ('test1')"
+${SQLITERUN} "INSERT INTO channels (tagid, link) VALUES (1, 'http://${HUB}/feed.xml')"
+
+python3 websub_hub.py ${HUB} &
+HUBPID=$!
+${RSSROLL} -W ${PUSH} &
+PUSHPID=$!
+trap 'kill ${HUBPID} ${PUSHPID}; rm -f websub.prom' EXIT
+sleep 1
+
+_print_header websub
+${RSSROLL} -H http://${PUSH}/push
+_wait "SELECT COUNT(*) FROM feeds;9"
+_wait "SELECT COUNT(*) FROM subscriptions WHERE expires > strftime('%s', 'now');1"
+_publish atom.xml
+_wait "SELECT COUNT(*) FROM feeds WHERE chanid=1;10"
+# channels pushed by the hub are not polled
+${RSSROLL} -H http://${PUSH}/push -m websub.prom
+grep -q '^rssroll_channels_total 0' websub.prom
+_print_footer
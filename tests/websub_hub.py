@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+#
+# Stand-in WebSub hub for websub.sh.
+#
+#   GET  /feed.xml		rss20.xml advertising this hub
+#   POST /hub			subscription request, verified in background
+#   POST /publish?file=F	push F to all verified subscribers
+#   GET  /subscriptions		number of verified subscriptions
+#
+import hashlib
+import hmac
+import secrets
+import sys
+import threading
+import urllib.parse
+import urllib.request
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+subscribers = {}
+lock = threading.Lock()
+
+
+def verify(form):
+    challenge = secrets.token_hex(8)
+    query = urllib.parse.urlencode({
+        'hub.mode': form['hub.mode'],
+        'hub.topic': form['hub.topic'],
+        'hub.challenge': challenge,
+        'hub.lease_seconds': form.get('hub.lease_seconds', '3600'),
+    })
+    try:
+        with urllib.request.urlopen(form['hub.callback'] + '?' + query) as r:
+            if r.read().decode() != challenge:
+                return
+    except OSError:
+        return
+    with lock:
+        subscribers[form['hub.callback']] = form.get('hub.secret', '')
+
+
+def publish(name):
+    with open(name, 'rb') as f:
+        body = f.read()
+    with lock:
+        targets = list(subscribers.items())
+    for callback, secret in targets:
+        headers = {'Content-Type': 'application/rss+xml'}
+        if secret:
+            mac = hmac.new(secret.encode(), body, hashlib.sha256)
+            headers['X-Hub-Signature'] = 'sha256=' + mac.hexdigest()
+        req = urllib.request.Request(callback, body, headers)
+        urllib.request.urlopen(req).read()
+    return len(targets)
+
+
+class Hub(BaseHTTPRequestHandler):
+    def reply(self, status, body=b''):
+        self.send_response(status)
+        self.send_header('Content-Length', str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def do_GET(self):
+        if self.path == '/feed.xml':
+            with open('rss20.xml', 'rb') as f:
+                feed = f.read()
+            link = ('<atom:link xmlns:atom="http://www.w3.org/2005/Atom" '
+                    'rel="hub" href="http://%s/hub"/>' % self.headers['Host'])
+            self.reply(200, feed.replace(b'<channel>',
+                                         b'<channel>' + link.encode(), 1))
+        elif self.path == '/subscriptions':
+            with lock:
+                self.reply(200, str(len(subscribers)).encode())
+        else:
+            self.reply(404)
+
+    def do_POST(self):
+        length = int(self.headers.get('Content-Length', 0))
+        body = self.rfile.read(length).decode()
+        url = urllib.parse.urlparse(self.path)
+        if url.path == '/hub':
+            form = dict(urllib.parse.parse_qsl(body))
+            self.reply(202)
+            threading.Thread(target=verify, args=(form,)).start()
+        elif url.path == '/publish':
+            name = urllib.parse.parse_qs(url.query)['file'][0]
+            self.reply(200, str(publish(name)).encode())
+        else:
+            self.reply(404)
+
+    def log_message(self, *args):
+        pass
+
+
+host, port = sys.argv[1].rsplit(':', 1)
+ThreadingHTTPServer((host, int(port)), Hub).serve_forever()